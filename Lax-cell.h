@@ -4,6 +4,7 @@
 #define _Lax_CELL_H
 
 #include "Lax.h"
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,6 +15,7 @@ enum Lax_port_kind {
   port_file=1,
   port_string=2,
   port_srfi6=4,
+  port_binary=8,
   port_input=16,
   port_output=32,
   port_saw_EOF=64
@@ -34,19 +36,42 @@ typedef struct port {
       char *start;
       char *past_the_end;
       char *curr;
+      char *buf;
     } string;
   } rep;
 } port;
 
+#if USE_COMPACT_CELLS
+typedef unsigned short cell_flag_t;
+#else
+typedef unsigned int cell_flag_t;
+#endif
+
 struct cell {
-  unsigned int _flag;
+#if !USE_COMPACT_CELLS
+  cell_flag_t _flag;
+#endif
   union {
     struct {
       char   *_svalue;
       int   _length;
+      int   _offset;
     } _string;
     num _number;
+    struct {
+      struct cell **_elems;
+      size_t _length;
+    } _vector;
+    struct {
+      char *_raw;
+      size_t _length;
+    } _numvec;
+    struct {
+      unsigned int *_limbs;
+      long _size;
+    } _bignum;
     port *_port;
+    struct hashtab *_hash;
     foreign_func _ff;
     struct {
       struct cell *_car;
@@ -63,37 +88,93 @@ int retcode;
 int tracing;
 
 
+/* cells come in CELL_SEGBYTES-aligned blocks whose header holds the
+   flags of compact cells and the mark bitmap, one bit per cell slot */
+#define USE_SEG_BLOCKS  (USE_COMPACT_CELLS || USE_MARK_BITMAP)
+#if USE_SEG_BLOCKS
+#ifndef CELL_SEGBYTES
+#define CELL_SEGBYTES   (1L<<17)
+#endif
+#define CELL_SLOTS      (CELL_SEGBYTES/sizeof(struct cell))
+#if USE_COMPACT_CELLS
+#define SEG_FLAGBYTES   (CELL_SLOTS*sizeof(cell_flag_t))
+#else
+#define SEG_FLAGBYTES   0
+#endif
+#if USE_MARK_BITMAP
+#define MARK_WORDS      ((CELL_SLOTS+63)/64)
+#define SEG_MARKBYTES   (MARK_WORDS*sizeof(uint64_t))
+#else
+#define SEG_MARKBYTES   0
+#endif
+#define CELL_SEGHDR     ((SEG_FLAGBYTES+SEG_MARKBYTES+sizeof(struct cell)-1)/sizeof(struct cell))
+#undef CELL_SEGSIZE
+#define CELL_SEGSIZE    ((long)(CELL_SLOTS-CELL_SEGHDR))
+#endif
 #ifndef CELL_SEGSIZE
 #define CELL_SEGSIZE    5000  
 #endif
 #ifndef CELL_NSEGMENT
-#define CELL_NSEGMENT   500    
+#define CELL_NSEGMENT   500     /* first size of the segment table */
 #endif
-char *alloc_seg[CELL_NSEGMENT];
-pointer cell_seg[CELL_NSEGMENT];
+char    **alloc_seg;
+pointer *cell_seg;
+int     seg_cap;        /* slots in alloc_seg and cell_seg */
 int     last_cell_seg;
+#if USE_MMAP_HEAP
+char    *heap_lo;       /* reserved address range */
+char    *heap_top;      /* segments are committed below it */
+char    *heap_hi;
+char    *heap_holes;    /* released segments, linked through their first word */
+long    heap_seg;       /* bytes per segment, whole pages */
+#endif
 
 pointer args;
 pointer envir;
 pointer code;
 pointer dump;
 
+/* multiple values returned by values, read back by their consumer */
+#ifndef MAX_VALUES
+#define MAX_VALUES 16
+#endif
+pointer values[MAX_VALUES];
+int     nvalues;
+pointer values_more;    /* those past MAX_VALUES, as a list */
+
 int interactive_repl;
 
+#if USE_SEG_BLOCKS
+char *const_seg;
+#else
 struct cell _sink;
-pointer sink;
 struct cell _NIL;
-pointer NIL;
 struct cell _HASHT;
-pointer T;
 struct cell _HASHF;
-pointer F;
 struct cell _EOF_OBJ;
+struct cell _VALUES;
+#endif
+pointer sink;
+pointer NIL;
+pointer T;
+pointer F;
 pointer EOF_OBJ;
+pointer VALUES;     /* stands for the contents of values[] */
 pointer oblist;
 pointer global_env;
 pointer c_nest;
 
+/* cells allocated since the opcode began, kept as roots till it ends */
+pointer *recent;
+int     nrecent;
+int     recent_cap;
+int     recent_base;    /* entries below it belong to an outer Lax_call */
+
+/* weak boxes, weak tables and guardians, for gc_weak() */
+pointer *weak;
+long    nweak;
+long    weak_cap;
+
 pointer LAMBDA;
 pointer QUOTE;
 
@@ -108,6 +189,57 @@ pointer COMPILE_HOOK;
 
 pointer free_cell;
 long    fcells;
+#if USE_GENERATIONAL_GC
+pointer bump;           /* allocation cursor in cell_seg[gen_seg] */
+pointer bump_end;
+int     gen_seg;
+int     gen_first;      /* segment the cursor started in after the last gc */
+long    nursery_left;   /* allocations until the next minor collection */
+#endif
+#if USE_LAZY_SWEEP
+int     gc_phase;       /* GC_IDLE, GC_MARK or GC_SWEEP */
+int     sweep_seg;      /* the sweep works down from last_cell_seg */
+pointer sweep_ptr;      /* cells below it in cell_seg[sweep_seg] are unswept */
+long    sweep_freed;    /* cells this sweep has freed so far */
+#endif
+#if USE_INCREMENTAL_GC
+pointer *gray;          /* marked cells whose children may not be */
+long    gray_top;
+long    gray_size;
+long    gc_debt;        /* cells allocated since the last slice */
+long    gc_pause_us;    /* longest slice in microseconds */
+#endif
+#if USE_FINALIZER_THREAD
+struct finalizer *fin;  /* releases dead payloads off the collector's path */
+#endif
+#if USE_PARALLEL_MARK
+int     gc_threads;     /* markers used by a collection of a large heap */
+#endif
+#if USE_HEAP_REGIONS
+struct region *region;  /* the checkpoint Lax_reset returns to */
+int     old_segs;       /* segments of the checkpoint, never swept */
+#endif
+#if USE_STRING_SLABS
+#ifndef STR_SLAB_CLASSES
+#define STR_SLAB_CLASSES 8      /* string blocks of 32 to 4096 bytes */
+#endif
+char    *str_free[STR_SLAB_CLASSES];    /* free blocks by size class */
+char    *str_slabs;     /* linked through their first word */
+#endif
+size_t  large_bytes;
+size_t  large_limit;
+#if USE_HEAP_QUOTAS
+size_t  str_bytes;      /* string buffers */
+size_t  soft_limit;     /* footprint that calls for a full collection */
+size_t  hard_limit;     /* footprint past which allocation fails */
+size_t  quota_trigger;  /* next footprint to collect at */
+char    over_quota;     /* an allocation was refused by hard_limit */
+char    quota_grace;    /* the quota error is being handled */
+char    quota_gc;       /* collect between opcodes */
+char    squeezing;      /* return every empty segment */
+pointer quota_dump;     /* where the running opcode started */
+pointer quota_envir;
+#endif
 
 pointer inport;
 pointer outport;
@@ -124,6 +256,7 @@ int nesting;
 
 char    gc_verbose;
 char    no_memory;
+char    in_error_hook;  /* errors inside *error-hook* are not hooked */
 
 #ifndef LINESIZE
 #define LINESIZE 1024
@@ -170,14 +303,15 @@ int is_real(pointer p);
 int is_character(pointer p);
 long charvalue(pointer p);
 int is_vector(pointer p);
+long vector_length(pointer vec);
 
 int is_port(pointer p);
 
 int is_pair(pointer p);
 pointer pair_car(pointer p);
 pointer pair_cdr(pointer p);
-pointer set_car(pointer p, pointer q);
-pointer set_cdr(pointer p, pointer q);
+pointer set_car(Lax *sc, pointer p, pointer q);
+pointer set_cdr(Lax *sc, pointer p, pointer q);
 
 int is_symbol(pointer p);
 char *symname(pointer p);
@@ -7,6 +7,7 @@
 #endif
 
 #include <limits.h>
+#include <stdint.h>
 #include <float.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -16,6 +17,24 @@
 #include <fcntl.h>
 
 #include "ili.h"
+#if USE_INCREMENTAL_GC
+#include <time.h>
+#endif
+#if USE_PARALLEL_MARK || USE_FINALIZER_THREAD
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+#if USE_MMAP_HEAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if !USE_SEG_BLOCKS && (defined(__unix__) || defined(__APPLE__))
+#define SEG_MMAP 1      /* see alloc_seg_raw() */
+#include <sys/mman.h>
+#else
+#define SEG_MMAP 0
+#endif
 #if USE_STRCASECMP
 #include <strings.h>
 #include <unistd.h>
@@ -89,6 +108,112 @@ static const char *strlwr(char *s) {
 # define FIRST_CELLSEGS 3
 #endif
 
+#ifndef GC_GROW_PERCENT
+# define GC_GROW_PERCENT 50     /* heap growth when a gc frees too little, */
+#endif
+
+#ifndef GC_MIN_FREE_PERCENT
+# define GC_MIN_FREE_PERCENT 25 /* which is less than this part of it */
+#endif
+
+#ifndef RECENT_ROOTS
+# define RECENT_ROOTS 1024      /* first size of the recent allocation stack */
+#endif
+
+#ifndef STR_MIN_SHIFT
+# define STR_MIN_SHIFT 5        /* the smallest string block is 1<<5 bytes */
+#endif
+
+#ifndef STR_SLAB_BYTES
+# define STR_SLAB_BYTES (1L<<16)
+#endif
+
+#ifndef VECTOR_LARGE_MIN
+# define VECTOR_LARGE_MIN 64
+#endif
+
+#ifndef LARGE_GC_MIN
+# define LARGE_GC_MIN (1L<<20)
+#endif
+
+#ifndef NUMVEC_ALIGN
+# define NUMVEC_ALIGN 32
+#endif
+
+#ifndef KARATSUBA_MIN
+# define KARATSUBA_MIN 32
+#endif
+
+#ifndef GC_NURSERY_CELLS
+# define GC_NURSERY_CELLS (1L<<16)
+#endif
+
+#ifndef MARK_STACK_LOCAL
+# define MARK_STACK_LOCAL 256   /* mark stack slots before it goes to malloc */
+#endif
+
+#ifndef MARK_PREFETCH
+# define MARK_PREFETCH 8        /* cells in flight while marking */
+#endif
+
+#ifndef GC_PAUSE_USEC
+# define GC_PAUSE_USEC 1000
+#endif
+
+#ifndef GC_STEP_CELLS
+# define GC_STEP_CELLS 4096
+#endif
+
+#if USE_GENERATIONAL_GC && (USE_INCREMENTAL_GC || USE_LAZY_SWEEP)
+# error "USE_GENERATIONAL_GC sweeps its own nursery and cannot be combined with USE_INCREMENTAL_GC or USE_LAZY_SWEEP"
+#endif
+
+#ifndef GC_MARK_THREADS
+# define GC_MARK_THREADS 0      /* 0: one per online processor */
+#endif
+
+#ifndef MAX_MARK_THREADS
+# define MAX_MARK_THREADS 64
+#endif
+
+#ifndef GC_PAR_MIN_CELLS
+# define GC_PAR_MIN_CELLS (1L<<20)
+#endif
+
+#if USE_PARALLEL_MARK && !(USE_MARK_BITMAP && defined(__GNUC__))
+# error "USE_PARALLEL_MARK needs USE_MARK_BITMAP and GCC atomics"
+#endif
+
+#ifndef GC_FIN_BATCH
+# define GC_FIN_BATCH 1024      /* releases handed to the finalizer at once */
+#endif
+
+#if USE_INCREMENTAL_GC && !USE_LAZY_SWEEP
+# error "USE_INCREMENTAL_GC needs USE_LAZY_SWEEP"
+#endif
+
+#if USE_HEAP_REGIONS && (USE_GENERATIONAL_GC || USE_LAZY_SWEEP)
+# error "USE_HEAP_REGIONS needs the eager, non-generational collector"
+#endif
+
+#ifndef HEAP_RESERVE
+# define HEAP_RESERVE ((size_t)1 << (sizeof(void*) > 4 ? 35 : 28))
+#endif
+
+#ifndef HEAP_ALIGN
+# define HEAP_ALIGN (1L<<21)    /* a huge page */
+#endif
+
+#ifndef HEAP_HUGEPAGES
+# define HEAP_HUGEPAGES 1
+#endif
+
+#if USE_MMAP_HEAP && !(defined(__unix__) || defined(__APPLE__))
+# error "USE_MMAP_HEAP needs mmap"
+#endif
+
+enum { GC_IDLE, GC_MARK, GC_SWEEP };
+
 enum Lax_types {
   T_STRING=1,
   T_NUMBER=2,
@@ -104,12 +229,23 @@ enum Lax_types {
   T_MACRO=12,
   T_PROMISE=13,
   T_ENVIRONMENT=14,
-  T_LAST_SYSTEM_TYPE=14
+  T_HASHTABLE=15,
+  T_RECORD=16,
+  T_RECTYPE=17,
+  T_RECPROC=18,
+  T_F64VECTOR=19,
+  T_S64VECTOR=20,
+  T_U8VECTOR=21,
+  T_BIGNUM=22,
+  T_WEAKBOX=23,
+  T_GUARDIAN=24,
+  T_LAST_SYSTEM_TYPE=24
 };
 
 #define ADJ 32
 #define TYPE_BITS 5
 #define T_MASKTYPE      31
+#define T_INLINE      2048
 #define T_SYNTAX      4096
 #define T_IMMUTABLE   8192
 #define T_ATOM       16384
@@ -135,26 +271,83 @@ static int num_le(num a, num b);
 static double round_per_R5RS(double x);
 #endif
 static int is_zero_double(double x);
-static INLINE int num_is_integer(pointer p) {
-  return ((p)->_object._number.is_fixnum);
-}
+
+/* Small fixnums and characters live in the pointer itself: tag 01 is a
+   fixnum, tag 10 a character.  Cells are ADJ-aligned, so no real cell
+   ever carries these bits, and an immediate never reaches the heap. */
+#if USE_IMMEDIATES
+#define IMM_MASK         3
+#define IMM_FIXNUM       1
+#define IMM_CHAR         2
+#define is_immediate(p)  (((uintptr_t)(p))&IMM_MASK)
+#define is_imm_fixnum(p) (((uintptr_t)(p))&IMM_FIXNUM)
+#define imm_fixnum(p)    ((long)(((intptr_t)(p))>>1))
+#define imm_char(p)      ((long)(((intptr_t)(p))>>2))
+#define mk_imm_fixnum(n) ((pointer)((((uintptr_t)(n))<<1)|IMM_FIXNUM))
+#define mk_imm_char(c)   ((pointer)((((uintptr_t)(c))<<2)|IMM_CHAR))
+#define fits_imm_fixnum(n) (imm_fixnum(mk_imm_fixnum(n))==(n))
+#define imm_ivalue(p)    (is_imm_fixnum(p)?imm_fixnum(p):imm_char(p))
+#define imm_flag(p)      ((is_imm_fixnum(p)?T_NUMBER:T_CHARACTER)|T_ATOM|MARK)
+#else
+#define is_immediate(p)  0
+#define imm_ivalue(p)    0L
+#define imm_flag(p)      0
+#endif
 
 static num num_zero;
 static num num_one;
 
+#if USE_COMPACT_CELLS
+#define seg_flags(p)     ((cell_flag_t*)((uintptr_t)(p)&~(uintptr_t)(CELL_SEGBYTES-1)))
+#define typeflag(p)      (seg_flags(p)[((uintptr_t)(p)&(CELL_SEGBYTES-1))/sizeof(struct cell)])
+#else
 #define typeflag(p)      ((p)->_flag)
-#define type(p)          (typeflag(p)&T_MASKTYPE)
+#endif
+#define cellflag(p)      (is_immediate(p)?imm_flag(p):typeflag(p))
+#define type(p)          (cellflag(p)&T_MASKTYPE)
+
+#define is_bignum(p)     (type(p)==T_BIGNUM)
+#define bigsize(p)       ((p)->_object._bignum._size)
+#define biglimbs(p)      ((p)->_object._bignum._limbs)
+#define bignlimbs(p)     ((size_t)(bigsize(p)<0?-bigsize(p):bigsize(p)))
+static double big_rvalue(pointer p);
+
+static INLINE int num_is_integer(pointer p) {
+  return is_immediate(p) || is_bignum(p) || ((p)->_object._number.is_fixnum);
+}
 
 INTERFACE INLINE int is_string(pointer p)     { return (type(p)==T_STRING); }
-#define strvalue(p)      ((p)->_object._string._svalue)
-#define strlength(p)        ((p)->_object._string._length)
+#define STR_INLINE_MAX   ((int)sizeof(((pointer)0)->_object)-2)
+#define is_inline_string(p) (typeflag(p)&T_INLINE)
+#define strinline(p)     ((char*)&(p)->_object)
+#define strvalue(p)      (is_inline_string(p)?strinline(p):(p)->_object._string._svalue+(p)->_object._string._offset)
+#define strbuf(p)        ((p)->_object._string._svalue)
+#define strbuf_refs(s)   (((long*)(s))[-1])
+#if USE_HEAP_QUOTAS
+#define strbuf_bytes(s)  (((long*)(s))[-2])
+#define STRBUF_QUOTA     1
+#else
+#define STRBUF_QUOTA     0
+#endif
+#if USE_STRING_SLABS
+#define strbuf_class(s)  (((long*)(s))[-2-STRBUF_QUOTA])
+#define strbuf_base(s)   (&strbuf_class(s))
+#define STRBUF_HDR       (2+STRBUF_QUOTA)
+#else
+#define strbuf_base(s)   (&strbuf_refs(s)-STRBUF_QUOTA)
+#define STRBUF_HDR       (1+STRBUF_QUOTA)
+#endif
+#define strlength(p)     (is_inline_string(p)?(int)(unsigned char)strinline(p)[STR_INLINE_MAX+1]:(p)->_object._string._length)
 
 INTERFACE static int is_list(Lax *sc, pointer p);
 INTERFACE INLINE int is_vector(pointer p)    { return (type(p)==T_VECTOR); }
-INTERFACE static void fill_vector(pointer vec, pointer obj);
+#define veclen(p)        ((p)->_object._vector._length)
+#define vecelems(p)      ((p)->_object._vector._elems)
+INTERFACE long vector_length(pointer vec)    { return (long)veclen(vec); }
+INTERFACE static void fill_vector(Lax *sc, pointer vec, pointer obj);
 INTERFACE static pointer vector_elem(pointer vec, int ielem);
-INTERFACE static pointer set_vector_elem(pointer vec, int ielem, pointer a);
-INTERFACE INLINE int is_number(pointer p)    { return (type(p)==T_NUMBER); }
+INTERFACE static pointer set_vector_elem(Lax *sc, pointer vec, int ielem, pointer a);
+INTERFACE INLINE int is_number(pointer p)    { int t=type(p); return (t==T_NUMBER || t==T_BIGNUM); }
 INTERFACE INLINE int is_integer(pointer p) {
   if (!is_number(p))
       return 0;
@@ -164,19 +357,33 @@ INTERFACE INLINE int is_integer(pointer p) {
 }
 
 INTERFACE INLINE int is_real(pointer p) {
-  return is_number(p) && (!(p)->_object._number.is_fixnum);
+  return is_number(p) && !num_is_integer(p);
 }
 
 INTERFACE INLINE int is_character(pointer p) { return (type(p)==T_CHARACTER); }
 INTERFACE INLINE char *string_value(pointer p) { return strvalue(p); }
-INLINE num nvalue(pointer p)       { return ((p)->_object._number); }
-INTERFACE long ivalue(pointer p)      { return (num_is_integer(p)?(p)->_object._number.value.ivalue:(long)(p)->_object._number.value.rvalue); }
-INTERFACE double rvalue(pointer p)    { return (!num_is_integer(p)?(p)->_object._number.value.rvalue:(double)(p)->_object._number.value.ivalue); }
+/* bignums go through the num_* functions as doubles; the exact paths
+   check for them first */
+INLINE num nvalue(pointer p) {
+  num n;
+  if(is_immediate(p)) {
+    n.is_fixnum=1;
+    n.value.ivalue=imm_ivalue(p);
+  } else if(is_bignum(p)) {
+    n.is_fixnum=0;
+    n.value.rvalue=big_rvalue(p);
+  } else {
+    return ((p)->_object._number);
+  }
+  return n;
+}
+INTERFACE long ivalue(pointer p)      { return (is_immediate(p)?imm_ivalue(p):is_bignum(p)?(bigsize(p)<0?LONG_MIN:LONG_MAX):num_is_integer(p)?(p)->_object._number.value.ivalue:(long)(p)->_object._number.value.rvalue); }
+INTERFACE double rvalue(pointer p)    { return (is_immediate(p)?(double)imm_ivalue(p):is_bignum(p)?big_rvalue(p):!num_is_integer(p)?(p)->_object._number.value.rvalue:(double)(p)->_object._number.value.ivalue); }
 #define ivalue_unchecked(p)       ((p)->_object._number.value.ivalue)
 #define rvalue_unchecked(p)       ((p)->_object._number.value.rvalue)
 #define set_num_integer(p)   (p)->_object._number.is_fixnum=1;
 #define set_num_real(p)      (p)->_object._number.is_fixnum=0;
-INTERFACE  long charvalue(pointer p)  { return ivalue_unchecked(p); }
+INTERFACE  long charvalue(pointer p)  { return is_immediate(p)?imm_ivalue(p):ivalue_unchecked(p); }
 
 INTERFACE INLINE int is_port(pointer p)     { return (type(p)==T_PORT); }
 INTERFACE INLINE int is_inport(pointer p)  { return is_port(p) && p->_object._port->kind & port_input; }
@@ -187,17 +394,15 @@ INTERFACE INLINE int is_pair(pointer p)     { return (type(p)==T_PAIR); }
 #define cdr(p)           ((p)->_object._cons._cdr)
 INTERFACE pointer pair_car(pointer p)   { return car(p); }
 INTERFACE pointer pair_cdr(pointer p)   { return cdr(p); }
-INTERFACE pointer set_car(pointer p, pointer q) { return car(p)=q; }
-INTERFACE pointer set_cdr(pointer p, pointer q) { return cdr(p)=q; }
 
 INTERFACE INLINE int is_symbol(pointer p)   { return (type(p)==T_SYMBOL); }
 INTERFACE INLINE char *symname(pointer p)   { return strvalue(car(p)); }
 #if USE_PLIST
-Lax_EXPORT INLINE int hasprop(pointer p)     { return (typeflag(p)&T_SYMBOL); }
+Lax_EXPORT INLINE int hasprop(pointer p)     { return (cellflag(p)&T_SYMBOL); }
 #define symprop(p)       cdr(p)
 #endif
 
-INTERFACE INLINE int is_syntax(pointer p)   { return (typeflag(p)&T_SYNTAX); }
+INTERFACE INLINE int is_syntax(pointer p)   { return (cellflag(p)&T_SYNTAX); }
 INTERFACE INLINE int is_proc(pointer p)     { return (type(p)==T_PROC); }
 INTERFACE INLINE int is_foreign(pointer p)  { return (type(p)==T_FOREIGN); }
 INTERFACE INLINE char *syntaxname(pointer p) { return strvalue(car(p)); }
@@ -217,16 +422,84 @@ INTERFACE INLINE int is_promise(pointer p)  { return (type(p)==T_PROMISE); }
 INTERFACE INLINE int is_environment(pointer p) { return (type(p)==T_ENVIRONMENT); }
 #define setenvironment(p)    typeflag(p) = T_ENVIRONMENT
 
-#define is_atom(p)       (typeflag(p)&T_ATOM)
+INTERFACE INLINE int is_hashtable(pointer p) { return (type(p)==T_HASHTABLE); }
+
+/* A weak box holds its object in car without keeping it alive; cdr is
+   #t once the object has been collected.  A guardian holds the objects
+   collected since they were registered with it in car and a chain of
+   weak boxes, one per registered object, in cdr. */
+INTERFACE INLINE int is_weakbox(pointer p)  { return (type(p)==T_WEAKBOX); }
+INTERFACE INLINE int is_guardian(pointer p) { return (type(p)==T_GUARDIAN); }
+
+INTERFACE INLINE int is_record(pointer p)   { return (type(p)==T_RECORD); }
+INTERFACE INLINE int is_rectype(pointer p)  { return (type(p)==T_RECTYPE); }
+#define is_recproc(p)    (type(p)==T_RECPROC)
+#define has_slots(p)     (is_vector(p) || is_record(p) || is_rectype(p))
+
+/* f64, s64 and u8 vectors keep unboxed elements in a malloc block aligned
+   to NUMVEC_ALIGN; the gc never looks inside them. */
+INTERFACE INLINE int is_f64vector(pointer p) { return (type(p)==T_F64VECTOR); }
+INTERFACE INLINE int is_s64vector(pointer p) { return (type(p)==T_S64VECTOR); }
+INTERFACE INLINE int is_u8vector(pointer p)  { return (type(p)==T_U8VECTOR); }
+INTERFACE INLINE int is_numvector(pointer p) { return is_f64vector(p) || is_s64vector(p) || is_u8vector(p); }
+#define numvec_len(p)    ((p)->_object._numvec._length)
+#define numvec_raw(p)    ((p)->_object._numvec._raw)
+#define numvec_data(p)   ((void*)(((uintptr_t)numvec_raw(p)+NUMVEC_ALIGN-1)&~(uintptr_t)(NUMVEC_ALIGN-1)))
+#define numvec_esize(p)  (is_u8vector(p)?1:8)
+/* longest vector of type t whose block size fits a size_t */
+#define numvec_max_len(t) ((SIZE_MAX-NUMVEC_ALIGN)/((t)==T_U8VECTOR?1:8))
+
+#define is_atom(p)       (cellflag(p)&T_ATOM)
 #define setatom(p)       typeflag(p) |= T_ATOM
 #define clratom(p)       typeflag(p) &= CLRATOM
 
-#define is_mark(p)       (typeflag(p)&MARK)
+#if USE_MARK_BITMAP
+#define seg_marks(p)     ((uint64_t*)(((uintptr_t)(p)&~(uintptr_t)(CELL_SEGBYTES-1))+SEG_FLAGBYTES))
+#define cell_slot(p)     (((uintptr_t)(p)&(CELL_SEGBYTES-1))/sizeof(struct cell))
+#define mark_word(p)     seg_marks(p)[cell_slot(p)>>6]
+#define mark_bit(p)      ((uint64_t)1<<(cell_slot(p)&63))
+#define is_mark(p)       (is_immediate(p) || (mark_word(p)&mark_bit(p)))
+#define setmark(p)       (mark_word(p) |= mark_bit(p))
+#define clrmark(p)       (mark_word(p) &= ~mark_bit(p))
+#else
+#define is_mark(p)       (cellflag(p)&MARK)
 #define setmark(p)       typeflag(p) |= MARK
 #define clrmark(p)       typeflag(p) &= UNMARK
+#endif
 
-INTERFACE INLINE int is_immutable(pointer p) { return (typeflag(p)&T_IMMUTABLE); }
-INTERFACE INLINE void setimmutable(pointer p) { typeflag(p) |= T_IMMUTABLE; }
+/* In the generational collector a cell stays marked from the collection
+   it survived until the next full one, so MARK doubles as "old".  A
+   store of a young pointer into an old cell promotes everything young
+   it reaches, which keeps old cells from ever pointing into the nursery
+   that a minor collection sweeps. */
+#if USE_GENERATIONAL_GC
+static void mark(pointer a);
+#define gc_barrier(sc,p,q)  do { if (is_mark(p) && (q) != 0 && !is_mark(q)) mark(q); } while (0)
+#define gc_keep(sc,p)    mark(p)
+#elif USE_INCREMENTAL_GC
+/* While an incremental collection marks, a marked cell must not be
+   handed an unmarked pointer the marker would never come back for, so
+   the barrier shades the stored object gray; the next slice scans it.
+   Only the instance that owns p can be marking it. */
+static void mark(pointer a);
+static void gc_shade(Lax *sc, pointer p);
+#define gc_barrier(sc,p,q)  do { if ((sc)->gc_phase == GC_MARK && is_mark(p)) gc_shade(sc, q); } while (0)
+/* a marked cell rebuilt in place stays marked */
+#define gc_keep(sc,p)    do { if ((sc)->gc_phase == GC_MARK) mark(p); else setmark(p); } while (0)
+#elif USE_LAZY_SWEEP
+#define gc_barrier(sc,p,q)  ((void)0)
+/* a marked cell rebuilt in place must outlive the sweep under way */
+#define gc_keep(sc,p)    setmark(p)
+#else
+#define gc_barrier(sc,p,q)  ((void)0)
+#define gc_keep(sc,p)    ((void)0)
+#endif
+
+INTERFACE pointer set_car(Lax *sc, pointer p, pointer q) { gc_barrier(sc,p,q); return car(p)=q; }
+INTERFACE pointer set_cdr(Lax *sc, pointer p, pointer q) { gc_barrier(sc,p,q); return cdr(p)=q; }
+
+INTERFACE INLINE int is_immutable(pointer p) { return (cellflag(p)&T_IMMUTABLE); }
+INTERFACE INLINE void setimmutable(pointer p) { if(!is_immediate(p)) typeflag(p) |= T_IMMUTABLE; }
 
 #define caar(p)          car(car(p))
 #define cadr(p)          car(cdr(p))
@@ -305,14 +578,19 @@ static void file_pop(Lax *sc);
 static int file_interactive(Lax *sc);
 static INLINE int is_one_of(char *s, int c);
 static int alloc_cellseg(Lax *sc, int n);
+static int grow_heap(Lax *sc);
 static long binary_decode(const char *s);
 static INLINE pointer get_cell(Lax *sc, pointer a, pointer b);
 static pointer _get_cell(Lax *sc, pointer a, pointer b);
 static pointer reserve_cells(Lax *sc, int n);
 static pointer get_consecutive_cells(Lax *sc, int n);
+#if !USE_GENERATIONAL_GC
 static pointer find_consecutive_cells(Lax *sc, int n);
-static void finalize_cell(Lax *sc, pointer a);
 static int count_consecutive_cells(pointer x, int needed);
+#endif
+static void finalize_cell(Lax *sc, pointer a);
+static void gc_release(Lax *sc, void *buf, FILE *file);
+static void gc_release_flush(Lax *sc);
 static pointer find_slot_in_env(Lax *sc, pointer env, pointer sym, int all);
 static pointer mk_number(Lax *sc, num n);
 static char *store_string(Lax *sc, int len, const char *str, char fill);
@@ -328,7 +606,29 @@ static port *port_rep_from_file(Lax *sc, FILE *, int prop);
 static port *port_rep_from_string(Lax *sc, char *start, char *past_the_end, int prop);
 static void port_close(Lax *sc, pointer p, int flag);
 static void mark(pointer a);
+struct mark_stack;
+static void mark_hashtable(struct mark_stack *ms, struct hashtab *h);
+#if USE_INCREMENTAL_GC
+static void shade_hashtable(Lax *sc, struct hashtab *h);
+#endif
+static void free_hashtable(Lax *sc, struct hashtab *h);
+static void gc_weak(Lax *sc);
 static void gc(Lax *sc, pointer a, pointer b);
+#if USE_GENERATIONAL_GC
+static void gc_minor(Lax *sc, pointer a, pointer b);
+#define gc_large(sc,a,b) gc_minor(sc,a,b)
+#elif USE_INCREMENTAL_GC
+static void gc_begin(Lax *sc);
+static void gc_step(Lax *sc);
+#define gc_large(sc,a,b) gc_begin(sc)
+#else
+#define gc_large(sc,a,b) gc(sc,a,b)
+#endif
+#if USE_LAZY_SWEEP
+static void gc_sweep_for_cell(Lax *sc);
+static pointer gc_sweep_for_run(Lax *sc, int n);
+static void gc_finish(Lax *sc);
+#endif
 static int basic_inchar(port *pt);
 static int inchar(Lax *sc);
 static void backchar(Lax *sc, int c);
@@ -345,7 +645,9 @@ static pointer mk_continuation(Lax *sc, pointer d);
 static pointer reverse(Lax *sc, pointer a);
 static pointer reverse_in_place(Lax *sc, pointer term, pointer list);
 static pointer revappend(Lax *sc, pointer a, pointer b);
-static void dump_stack_mark(Lax *);
+#ifndef USE_Lax_STACK
+static void dump_stack_visit(Lax *, void (*)(void *, pointer), void *);
+#endif
 static pointer opexe_0(Lax *sc, enum Lax_opcodes op);
 static pointer opexe_1(Lax *sc, enum Lax_opcodes op);
 static pointer opexe_2(Lax *sc, enum Lax_opcodes op);
@@ -354,6 +656,8 @@ static pointer opexe_4(Lax *sc, enum Lax_opcodes op);
 static pointer opexe_5(Lax *sc, enum Lax_opcodes op);
 static pointer opexe_6(Lax *sc, enum Lax_opcodes op);
 static void Eval_Cycle(Lax *sc, enum Lax_opcodes op);
+static void s_save(Lax *sc, enum Lax_opcodes op, pointer args, pointer code);
+static pointer values_set(Lax *sc, pointer a);
 static void assign_syntax(Lax *sc, char *name);
 static int syntaxnum(pointer p);
 static void assign_proc(Lax *sc, enum Lax_opcodes, char *name);
@@ -530,23 +834,266 @@ static long binary_decode(const char *s) {
  return x;
 }
 
+#if USE_MMAP_HEAP
+/* Segments are committed one after another from a single reserved
+   range, so the heap is contiguous, marking walks few pages, and a
+   pointer is checked against the heap with one compare. */
+#ifndef MAP_ANONYMOUS
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+# define MAP_NORESERVE 0
+#endif
+
+#define in_heap(sc,p) \
+  ((uintptr_t)((char*)(p) - (sc)->heap_lo) < (uintptr_t)((sc)->heap_top - (sc)->heap_lo))
+
+static void heap_reserve(Lax *sc) {
+  long page = sysconf(_SC_PAGESIZE);
+  uintptr_t align = HEAP_ALIGN;
+  size_t len;
+  char *cp;
+
+  sc->heap_lo = sc->heap_top = sc->heap_hi = sc->heap_holes = 0;
+  if (sc->malloc != malloc) {
+    return;
+  }
+#if USE_SEG_BLOCKS
+  sc->heap_seg = CELL_SEGBYTES;
+  if (align < CELL_SEGBYTES) {
+    align = CELL_SEGBYTES;
+  }
+#else
+  sc->heap_seg = CELL_SEGSIZE * sizeof(struct cell);
+#endif
+  sc->heap_seg = (sc->heap_seg + page - 1) / page * page;
+  len = HEAP_RESERVE + align;
+  cp = (char*)mmap(0, len, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (cp == (char*)MAP_FAILED) {
+    return;
+  }
+  sc->heap_lo = (char*)(((uintptr_t)cp + align - 1) & ~(align - 1));
+  if (sc->heap_lo > cp) {
+    munmap(cp, sc->heap_lo - cp);
+  }
+  munmap(sc->heap_lo + HEAP_RESERVE, cp + len - (sc->heap_lo + HEAP_RESERVE));
+  sc->heap_top = sc->heap_lo;
+  sc->heap_hi = sc->heap_lo + HEAP_RESERVE;
+#if HEAP_HUGEPAGES && defined(MADV_HUGEPAGE)
+  madvise(sc->heap_lo, HEAP_RESERVE, MADV_HUGEPAGE);
+#endif
+}
+
+/* the next segment, or 0 once the range is used up */
+static char *heap_commit(Lax *sc) {
+  char *cp = sc->heap_holes;
+
+  if (cp != 0) {
+    sc->heap_holes = *(char**)cp;
+    return cp;
+  }
+  if (sc->heap_hi - sc->heap_top < sc->heap_seg) {
+    return 0;
+  }
+  cp = sc->heap_top;
+  if (mprotect(cp, sc->heap_seg, PROT_READ|PROT_WRITE) != 0) {
+    return 0;
+  }
+  sc->heap_top += sc->heap_seg;
+  return cp;
+}
+
+/* pages of a released segment go back to the system; it stays mapped
+   for reuse */
+static void heap_decommit(Lax *sc, char *cp) {
+#ifdef MADV_DONTNEED
+  madvise(cp, sc->heap_seg, MADV_DONTNEED);
+#endif
+  *(char**)cp = sc->heap_holes;
+  sc->heap_holes = cp;
+}
+#endif
+
+#if !USE_SEG_BLOCKS
+#define SEG_RAW_BYTES  ((size_t)CELL_SEGSIZE*sizeof(struct cell) \
+    + (ADJ < sizeof(struct cell) ? sizeof(struct cell) : ADJ))
+
+/* With the system malloc a segment is mapped on its own: glibc keeps
+   freed blocks of this size in its arena, so releasing one there would
+   give nothing back to the system. */
+static char *alloc_seg_raw(Lax *sc) {
+  char *cp;
+
+#if USE_MMAP_HEAP
+  if ((cp = heap_commit(sc)) != 0) {
+    return cp;
+  }
+#endif
+#if SEG_MMAP
+  if (sc->malloc == malloc) {
+    cp = (char*)mmap(0, SEG_RAW_BYTES, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    return cp == (char*)MAP_FAILED ? 0 : cp;
+  }
+#endif
+  cp = (char*)sc->malloc(SEG_RAW_BYTES);
+  return cp;
+}
+#endif
+
+/* release what alloc_seg_raw or alloc_seg_block allocated */
+static void free_seg(Lax *sc, char *raw) {
+#if USE_MMAP_HEAP
+  if (in_heap(sc, raw)) {
+    heap_decommit(sc, raw);
+    return;
+  }
+#endif
+#if SEG_MMAP
+  if (sc->malloc == malloc) {
+    munmap(raw, SEG_RAW_BYTES);
+    return;
+  }
+#endif
+  sc->free(raw);
+}
+
+#if USE_SEG_BLOCKS
+/* Compact cells keep their flags, and USE_MARK_BITMAP its mark bits, in
+   side arrays at the start of each CELL_SEGBYTES-aligned block, so the
+   block base is found by masking. */
+static char *alloc_seg_block(Lax *sc, char **raw) {
+  char *cp;
+
+#if USE_MMAP_HEAP
+  if ((cp = heap_commit(sc)) != 0) {
+    *raw = cp;
+    return cp;
+  }
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+  if (sc->malloc == malloc) {
+    void *mem;
+    if (posix_memalign(&mem, CELL_SEGBYTES, CELL_SEGBYTES) != 0)
+      return 0;
+    *raw = (char*)mem;
+    return (char*)mem;
+  }
+#endif
+  cp = (char*) sc->malloc(2*CELL_SEGBYTES);
+  if (cp == 0)
+    return 0;
+  *raw = cp;
+  return (char*)(((uintptr_t)cp+CELL_SEGBYTES-1)&~(uintptr_t)(CELL_SEGBYTES-1));
+}
+#endif
+
+#if USE_MARK_BITMAP
+/* Clearing the marks of a segment is a memset.  The bits of the header
+   slots and of the slack past the last cell stay set, so the sweep can
+   pass over any all-ones word. */
+static void seg_clear_marks(uint64_t *m) {
+  long s;
+
+  memset(m, 0, SEG_MARKBYTES);
+  for (s = 0; s < (long)CELL_SEGHDR; s++) {
+    m[s>>6] |= (uint64_t)1<<(s&63);
+  }
+  for (s = CELL_SLOTS; s < (long)MARK_WORDS*64; s++) {
+    m[s>>6] |= (uint64_t)1<<(s&63);
+  }
+}
+#endif
+
+#if USE_GENERATIONAL_GC || USE_INCREMENTAL_GC || USE_HEAP_REGIONS
+static void seg_unmark(pointer seg) {
+#if USE_MARK_BITMAP
+  seg_clear_marks(seg_marks(seg));
+#else
+  pointer p;
+  for (p = seg; p < seg + CELL_SEGSIZE; p++) {
+    clrmark(p);
+  }
+#endif
+}
+#endif
+
+#if USE_GENERATIONAL_GC || USE_INCREMENTAL_GC
+static void clear_marks(Lax *sc) {
+  int i;
+  for (i = sc->last_cell_seg; i >= 0; i--) {
+    seg_unmark(sc->cell_seg[i]);
+  }
+}
+#endif
+
+/* double the segment table */
+static int grow_seg_table(Lax *sc) {
+     int cap = sc->seg_cap ? 2*sc->seg_cap : CELL_NSEGMENT;
+     char **as = (char**)sc->malloc(cap*sizeof(char*));
+     pointer *cs = (pointer*)sc->malloc(cap*sizeof(pointer));
+
+     if (as == 0 || cs == 0) {
+          if (as) sc->free(as);
+          if (cs) sc->free(cs);
+          return 0;
+     }
+     if (sc->seg_cap) {
+          memcpy(as, sc->alloc_seg, sc->seg_cap*sizeof(char*));
+          memcpy(cs, sc->cell_seg, sc->seg_cap*sizeof(pointer));
+          sc->free(sc->alloc_seg);
+          sc->free(sc->cell_seg);
+     }
+     sc->alloc_seg = as;
+     sc->cell_seg = cs;
+     sc->seg_cap = cap;
+     return 1;
+}
+
+/* every cell of a segment becomes free */
+static void seg_init_free(Lax *sc, pointer newp) {
+     pointer last = newp + CELL_SEGSIZE - 1;
+     pointer p;
+
+#if USE_MARK_BITMAP
+     seg_clear_marks(seg_marks(newp));
+#endif
+     sc->fcells += CELL_SEGSIZE;
+     for (p = newp; p <= last; p++) {
+          typeflag(p) = 0;
+          cdr(p) = p + 1;
+          car(p) = sc->NIL;
+     }
+#if !USE_GENERATIONAL_GC
+     /* the generational allocator finds free cells by their flags */
+     cdr(last) = sc->free_cell;
+     sc->free_cell = newp;
+#endif
+}
+
 static int alloc_cellseg(Lax *sc, int n) {
      pointer newp;
-     pointer last;
-     pointer p;
      char *cp;
      long i;
      int k;
+#if !USE_SEG_BLOCKS
      int adj=ADJ;
 
      if(adj<sizeof(struct cell)) {
        adj=sizeof(struct cell);
      }
+#endif
 
      for (k = 0; k < n; k++) {
-         if (sc->last_cell_seg >= CELL_NSEGMENT - 1)
+         if (sc->last_cell_seg + 1 >= sc->seg_cap && !grow_seg_table(sc))
+              return k;
+#if USE_SEG_BLOCKS
+         cp = alloc_seg_block(sc, &sc->alloc_seg[sc->last_cell_seg+1]);
+         if (cp == 0)
               return k;
-         cp = (char*) sc->malloc(CELL_SEGSIZE * sizeof(struct cell)+adj);
+         i = ++sc->last_cell_seg ;
+         newp=(pointer)cp + CELL_SEGHDR;
+#else
+         cp = alloc_seg_raw(sc);
          if (cp == 0)
               return k;
          i = ++sc->last_cell_seg ;
@@ -555,113 +1102,343 @@ static int alloc_cellseg(Lax *sc, int n) {
            cp=(char*)(adj*((unsigned long)cp/adj+1));
          }
          newp=(pointer)cp;
+#endif
          sc->cell_seg[i] = newp;
-         while (i > 0 && sc->cell_seg[i - 1] > sc->cell_seg[i]) {
-             p = sc->cell_seg[i];
-             sc->cell_seg[i] = sc->cell_seg[i - 1];
-             sc->cell_seg[--i] = p;
-         }
-         sc->fcells += CELL_SEGSIZE;
-         last = newp + CELL_SEGSIZE - 1;
-         for (p = newp; p <= last; p++) {
-              typeflag(p) = 0;
-              cdr(p) = p + 1;
-              car(p) = sc->NIL;
-         }
-         if (sc->free_cell == sc->NIL || p < sc->free_cell) {
-              cdr(last) = sc->free_cell;
-              sc->free_cell = newp;
-         } else {
-               p = sc->free_cell;
-               while (cdr(p) != sc->NIL && newp > cdr(p))
-                    p = cdr(p);
-               cdr(last) = cdr(p);
-               cdr(p) = newp;
-         }
+         seg_init_free(sc, newp);
      }
      return n;
 }
 
-static INLINE pointer get_cell_x(Lax *sc, pointer a, pointer b) {
-  if (sc->free_cell != sc->NIL) {
-    pointer x = sc->free_cell;
-    sc->free_cell = cdr(x);
-    --sc->fcells;
-    return (x);
-  }
-  return _get_cell (sc, a, b);
-}
+/* the segments a collection sweeps */
+#if USE_HEAP_REGIONS
+#define heap_segs(sc)    ((sc)->last_cell_seg + 1 - (sc)->old_segs)
+#else
+#define heap_segs(sc)    ((sc)->last_cell_seg + 1)
+#endif
 
-static pointer _get_cell(Lax *sc, pointer a, pointer b) {
-  pointer x;
+#if !USE_GENERATIONAL_GC && !USE_INCREMENTAL_GC
+/* a gc that freed fewer than GC_MIN_FREE_PERCENT of the cells */
+static int heap_short(Lax *sc, long freed) {
+     long cells = heap_segs(sc) * CELL_SEGSIZE;
+     return freed < cells / 100 * GC_MIN_FREE_PERCENT;
+}
+#endif
 
-  if(sc->no_memory) {
-    return sc->sink;
-  }
+#if USE_HEAP_QUOTAS
+/* what the instance holds: cell segments, string buffers, large objects */
+#define heap_footprint(sc) ((size_t)((sc)->last_cell_seg + 1) * CELL_SEGSIZE \
+    * sizeof(struct cell) + (sc)->large_bytes + (sc)->str_bytes)
+
+static int heap_quota(Lax *sc, size_t extra, int can_gc);
+#define heap_quota_segs(sc,n) heap_quota(sc, \
+    (size_t)(n) * CELL_SEGSIZE * sizeof(struct cell), 0)
+#define heap_squeezing(sc) ((sc)->squeezing)
+#define heap_over_quota(sc) ((sc)->over_quota)
+/* the hook has returned or escaped, and with it the quota grace */
+#define error_hook_done(sc) ((sc)->in_error_hook = 0, (sc)->quota_grace = 0)
+#else
+#define heap_quota_segs(sc,n) 1
+#define heap_squeezing(sc) 0
+#define heap_over_quota(sc) 0
+#define error_hook_done(sc) ((sc)->in_error_hook = 0)
+#endif
 
-  if (sc->free_cell == sc->NIL) {
-    const int min_to_be_recovered = sc->last_cell_seg*8;
-    gc(sc,a, b);
-    if (sc->fcells < min_to_be_recovered
-        || sc->free_cell == sc->NIL) {
-      if (!alloc_cellseg(sc,1) && sc->free_cell == sc->NIL) {
-        sc->no_memory=1;
-        return sc->sink;
-      }
-    }
-  }
-  x = sc->free_cell;
-  sc->free_cell = cdr(x);
-  --sc->fcells;
-  return (x);
+/* add GC_GROW_PERCENT of the heap, at least a segment */
+static int grow_heap(Lax *sc) {
+     long n = (long)heap_segs(sc) * GC_GROW_PERCENT / 100;
+     if (n <= 0) {
+          n = 1;
+     }
+#if USE_HEAP_QUOTAS
+     /* the caller has just collected */
+     while (!heap_quota(sc, n * CELL_SEGSIZE * sizeof(struct cell), 0)) {
+          if (n == 1) {
+               return 0;
+          }
+          n /= 2;
+     }
+#endif
+     return alloc_cellseg(sc, (int)n);
 }
 
-static pointer reserve_cells(Lax *sc, int n) {
-    if(sc->no_memory) {
-        return sc->NIL;
-    }
+#if !USE_GENERATIONAL_GC && !USE_LAZY_SWEEP
+/* Give segments the sweep found empty back to the system while two
+   thirds of the heap would still be free, or all of them when squeezing
+   under a quota.  Their first cell was tagged by the sweep; each
+   segment is one run on the free list. */
+static void release_cellsegs(Lax *sc, int empty) {
+     long cells = heap_segs(sc) * CELL_SEGSIZE;
+     pointer *pp = &sc->free_cell;
+     pointer p;
+     int i;
 
-    if (sc->fcells < n) {
-        gc(sc, sc->NIL, sc->NIL);
-        if (sc->fcells < n) {
-            if (!alloc_cellseg(sc,1)) {
-                sc->no_memory=1;
-                return sc->NIL;
-            }
-        }
-        if (sc->fcells < n) {
-            sc->no_memory=1;
-            return sc->NIL;
-        }
-    }
-    return (sc->T);
+     while (empty > 0 && (p = *pp) != sc->NIL) {
+          if (car(p) != sc->T) {
+               pp = &cdr(p);
+               continue;
+          }
+          car(p) = sc->NIL;
+          empty--;
+          if (heap_segs(sc) <= FIRST_CELLSEGS
+              || (!heap_squeezing(sc)
+                  && 3*(sc->fcells - CELL_SEGSIZE) <= 2*(cells - CELL_SEGSIZE))) {
+               pp = &cdr(p + CELL_SEGSIZE - 1);
+               continue;
+          }
+          *pp = cdr(p + CELL_SEGSIZE - 1);
+          for (i = sc->last_cell_seg; sc->cell_seg[i] != p; i--)
+               ;
+          free_seg(sc, sc->alloc_seg[i]);
+          sc->alloc_seg[i] = sc->alloc_seg[sc->last_cell_seg];
+          sc->cell_seg[i] = sc->cell_seg[sc->last_cell_seg];
+          sc->last_cell_seg--;
+          sc->fcells -= CELL_SEGSIZE;
+          cells -= CELL_SEGSIZE;
+     }
 }
+#endif
 
-static pointer get_consecutive_cells(Lax *sc, int n) {
-  pointer x;
+#if USE_GENERATIONAL_GC
+/* The nursery is the run of segments the allocation cursor has bumped
+   through since the last collection, from gen_first to gen_seg.  The
+   cursor skips cells that are still in use, so every young cell lies in
+   those segments and a minor collection sweeps nothing else. */
 
-  if(sc->no_memory) { return sc->sink; }
+static void gen_cursor(Lax *sc, int i) {
+  sc->gen_seg = i;
+  sc->bump = sc->cell_seg[i];
+  sc->bump_end = sc->cell_seg[i] + CELL_SEGSIZE;
+}
+
+/* after any collection the nursery restarts at the current segment */
+static void gen_reset(Lax *sc) {
+  gen_cursor(sc, sc->gen_seg);
+  sc->gen_first = sc->gen_seg;
+  sc->nursery_left = GC_NURSERY_CELLS;
+}
+
+/* 0 once the cursor would come back round to gen_first */
+static int gen_next_seg(Lax *sc) {
+  int i = sc->gen_seg < sc->last_cell_seg ? sc->gen_seg + 1 : 0;
+  if (i == sc->gen_first) {
+    return 0;
+  }
+  gen_cursor(sc, i);
+  return 1;
+}
+
+/* full collection, then grow so that a quarter of the heap is free */
+static void gen_full(Lax *sc, pointer a, pointer b) {
+  long cells, want;
+  int first = sc->last_cell_seg + 1;
+
+  gc(sc, a, b);
+  cells = (sc->last_cell_seg + 1) * CELL_SEGSIZE;
+  want = cells/4 - sc->fcells;
+  if (want <= 0) {
+    return;
+  }
+  if (!heap_quota_segs(sc, want / CELL_SEGSIZE + 1)) {
+    /* as in _get_cell: fail with the quota error */
+    sc->no_memory = 1;
+    return;
+  }
+  if (alloc_cellseg(sc, (int)(want / CELL_SEGSIZE) + 1) > 0) {
+    gen_cursor(sc, first);
+    gen_reset(sc);
+  }
+}
+
+/* n consecutive free cells from the cursor on */
+static pointer gen_alloc(Lax *sc, int n, pointer a, pointer b) {
+  int tries = 0, k;
+  pointer x;
+
+  for (;;) {
+    if (sc->no_memory) {
+      return sc->sink;
+    }
+    if (sc->nursery_left >= n) {
+      for (x = sc->bump; x + n <= sc->bump_end; x += k + 1) {
+        for (k = 0; k < n && typeflag(x + k) == 0; k++)
+          ;
+        if (k == n) {
+          sc->bump = x + n;
+          sc->nursery_left -= n;
+          sc->fcells -= n;
+          return x;
+        }
+      }
+      sc->bump = sc->bump_end;
+      if (gen_next_seg(sc)) {
+        continue;
+      }
+    }
+    switch (tries++) {
+    case 0:
+      gc_minor(sc, a, b);
+      break;
+    case 1:
+      gen_full(sc, a, b);
+      break;
+    case 2:
+      k = sc->last_cell_seg + 1;
+      if (grow_heap(sc) > 0) {
+        gen_cursor(sc, k);
+        gen_reset(sc);
+        break;
+      }
+      /* fall through */
+    default:
+      sc->no_memory = 1;
+      break;
+    }
+  }
+}
+
+static INLINE pointer get_cell_x(Lax *sc, pointer a, pointer b) {
+  if (sc->nursery_left > 0) {
+    pointer x;
+    while ((x = sc->bump) < sc->bump_end) {
+      sc->bump = x + 1;
+      if (typeflag(x) == 0) {
+        --sc->nursery_left;
+        --sc->fcells;
+        return x;
+      }
+    }
+  }
+  return _get_cell (sc, a, b);
+}
+
+static pointer _get_cell(Lax *sc, pointer a, pointer b) {
+  return gen_alloc(sc, 1, a, b);
+}
+
+#else
+
+#if USE_INCREMENTAL_GC
+static int gray_push(Lax *sc, pointer p);
+/* cells handed out while marking are scanned once they are built */
+#define gc_note_alloc(sc,x) do { if ((sc)->gc_phase != GC_IDLE) { \
+    (sc)->gc_debt++; \
+    if ((sc)->gc_phase == GC_MARK) gray_push(sc, x); } } while (0)
+#else
+#define gc_note_alloc(sc,x) ((void)0)
+#endif
+
+static INLINE pointer get_cell_x(Lax *sc, pointer a, pointer b) {
+  if (sc->free_cell != sc->NIL) {
+    pointer x = sc->free_cell;
+    sc->free_cell = cdr(x);
+    --sc->fcells;
+    gc_note_alloc(sc, x);
+    return (x);
+  }
+  return _get_cell (sc, a, b);
+}
+
+static pointer _get_cell(Lax *sc, pointer a, pointer b) {
+  pointer x;
+
+  if(sc->no_memory) {
+    return sc->sink;
+  }
+
+#if USE_LAZY_SWEEP
+  gc_sweep_for_cell(sc);
+  if (sc->free_cell == sc->NIL) {
+    gc(sc,a, b);
+    gc_sweep_for_cell(sc);
+    if (sc->free_cell == sc->NIL && !grow_heap(sc)) {
+      sc->no_memory=1;
+      return sc->sink;
+    }
+  }
+#else
+  if (sc->free_cell == sc->NIL) {
+    gc(sc,a, b);
+    if (heap_short(sc, sc->fcells) || sc->free_cell == sc->NIL) {
+      /* a full heap the quota keeps from growing would collect for
+         every few cells; fail and let the quota error be raised */
+      if (!grow_heap(sc) && (sc->free_cell == sc->NIL || heap_over_quota(sc))) {
+        sc->no_memory=1;
+        return sc->sink;
+      }
+    }
+  }
+#endif
+  x = sc->free_cell;
+  sc->free_cell = cdr(x);
+  --sc->fcells;
+  gc_note_alloc(sc, x);
+  return (x);
+}
+#endif
+
+static pointer reserve_cells(Lax *sc, int n) {
+    if(sc->no_memory) {
+        return sc->NIL;
+    }
+
+    if (sc->fcells < n) {
+        gc(sc, sc->NIL, sc->NIL);
+#if USE_LAZY_SWEEP
+        gc_finish(sc);
+#endif
+        if (sc->fcells < n) {
+            if (!grow_heap(sc)) {
+                sc->no_memory=1;
+                return sc->NIL;
+            }
+        }
+        if (sc->fcells < n) {
+            sc->no_memory=1;
+            return sc->NIL;
+        }
+    }
+    return (sc->T);
+}
+
+static pointer get_consecutive_cells(Lax *sc, int n) {
+#if USE_GENERATIONAL_GC
+  return gen_alloc(sc, n, sc->NIL, sc->NIL);
+#else
+  pointer x;
+
+  if(sc->no_memory) { return sc->sink; }
 
   x=find_consecutive_cells(sc,n);
-  if (x != sc->NIL) { return x; }
+  if (x != sc->NIL) { gc_note_alloc(sc, x); return x; }
+
+#if USE_LAZY_SWEEP
+  x=gc_sweep_for_run(sc,n);
+  if (x != sc->NIL) { gc_note_alloc(sc, x); return x; }
 
+  gc(sc, sc->NIL, sc->NIL);
+  x=gc_sweep_for_run(sc,n);
+#else
   gc(sc, sc->NIL, sc->NIL);
   x=find_consecutive_cells(sc,n);
-  if (x != sc->NIL) { return x; }
+#endif
+  if (x != sc->NIL) { gc_note_alloc(sc, x); return x; }
 
-  if (!alloc_cellseg(sc,1))
+  if (!grow_heap(sc))
     {
       sc->no_memory=1;
       return sc->sink;
     }
 
   x=find_consecutive_cells(sc,n);
-  if (x != sc->NIL) { return x; }
+  if (x != sc->NIL) { gc_note_alloc(sc, x); return x; }
 
   sc->no_memory=1;
   return sc->sink;
+#endif
 }
 
+#if !USE_GENERATIONAL_GC
+
 static int count_consecutive_cells(pointer x, int needed) {
  int n=1;
  while(cdr(x)==x+1) {
@@ -689,14 +1466,40 @@ static pointer find_consecutive_cells(Lax *sc, int n) {
   }
   return sc->NIL;
 }
+#endif
+
+/* double the recent allocation stack */
+static int grow_recent(Lax *sc) {
+  int cap = 2*sc->recent_cap;
+  pointer *r = (pointer*)sc->malloc(cap*sizeof(pointer));
+
+  if (r == 0) {
+    return 0;
+  }
+  memcpy(r, sc->recent, sc->nrecent*sizeof(pointer));
+  sc->free(sc->recent);
+  sc->recent = r;
+  sc->recent_cap = cap;
+  return 1;
+}
 
-static void push_recent_alloc(Lax *sc, pointer recent, pointer extra)
+static INLINE void push_recent_alloc(Lax *sc, pointer recent)
 {
-  pointer holder = get_cell_x(sc, recent, extra);
-  typeflag(holder) = T_PAIR | T_IMMUTABLE;
-  car(holder) = recent;
-  cdr(holder) = car(sc->sink);
-  car(sc->sink) = holder;
+  if (sc->nrecent == sc->recent_cap && !grow_recent(sc)) {
+    sc->no_memory=1;
+    return;
+  }
+  sc->recent[sc->nrecent++] = recent;
+}
+
+/* C code keeps objects alive across allocations with these; whatever
+   is still pushed is dropped when the opcode ends */
+void Lax_protect(Lax *sc, pointer p) {
+  push_recent_alloc(sc, p);
+}
+
+void Lax_unprotect(Lax *sc, int n) {
+  sc->nrecent = sc->nrecent - n > sc->recent_base ? sc->nrecent - n : sc->recent_base;
 }
 
 
@@ -706,25 +1509,67 @@ static pointer get_cell(Lax *sc, pointer a, pointer b)
   typeflag(cell) = T_PAIR;
   car(cell) = a;
   cdr(cell) = b;
-  push_recent_alloc(sc, cell, sc->NIL);
+  push_recent_alloc(sc, cell);
   return cell;
 }
 
-static pointer get_vector_object(Lax *sc, int len, pointer init)
+#define VECTOR_MAX_LEN   (SIZE_MAX/sizeof(pointer))
+
+/* Vectors of VECTOR_LARGE_MIN or more elements keep their slots in a
+   separate malloc block instead of a run of consecutive free cells.
+   Those blocks are counted in large_bytes, which also triggers gc. */
+static pointer get_large_vector(Lax *sc, size_t len, pointer init)
+{
+  pointer x;
+  pointer *elems;
+
+  if(sc->large_bytes > sc->large_limit) {
+    gc_large(sc, init, sc->NIL);
+  }
+  if(len > VECTOR_MAX_LEN) {
+    sc->no_memory=1;
+    return sc->sink;
+  }
+  x = get_cell(sc, init, sc->NIL);
+  if(sc->no_memory) { return sc->sink; }
+#if USE_HEAP_QUOTAS
+  if(!heap_quota(sc, len*sizeof(pointer), 1)) {
+    sc->no_memory=1;
+    return sc->sink;
+  }
+#endif
+  elems = (pointer*)sc->malloc(len*sizeof(pointer));
+  if(elems == 0) {
+    sc->no_memory=1;
+    return sc->sink;
+  }
+  typeflag(x) = (T_VECTOR | T_ATOM);
+  vecelems(x) = elems;
+  veclen(x) = len;
+  sc->large_bytes += len*sizeof(pointer);
+  fill_vector(sc,x,init);
+  return x;
+}
+
+static pointer get_vector_object(Lax *sc, size_t len, pointer init)
 {
-  pointer cells = get_consecutive_cells(sc,len/2+len%2+1);
+  pointer cells;
+  if(len >= VECTOR_LARGE_MIN) {
+    return get_large_vector(sc,len,init);
+  }
+  cells = get_consecutive_cells(sc,len/2+len%2+1);
   if(sc->no_memory) { return sc->sink; }
   typeflag(cells) = (T_VECTOR | T_ATOM);
-  ivalue_unchecked(cells)=len;
-  set_num_integer(cells);
-  fill_vector(cells,init);
-  push_recent_alloc(sc, cells, sc->NIL);
+  vecelems(cells) = 0;
+  veclen(cells) = len;
+  fill_vector(sc,cells,init);
+  push_recent_alloc(sc, cells);
   return cells;
 }
 
 static INLINE void ok_to_freely_gc(Lax *sc)
 {
-  car(sc->sink) = sc->NIL;
+  sc->nrecent = sc->recent_base;
 }
 
 
@@ -780,8 +1625,8 @@ static pointer oblist_add_by_name(Lax *sc, const char *name)
   typeflag(x) = T_SYMBOL;
   setimmutable(car(x));
 
-  location = hash_fn(name, ivalue_unchecked(sc->oblist));
-  set_vector_elem(sc->oblist, location,
+  location = hash_fn(name, veclen(sc->oblist));
+  set_vector_elem(sc, sc->oblist, location,
                   immutable_cons(sc, x, vector_elem(sc->oblist, location)));
   return x;
 }
@@ -792,7 +1637,7 @@ static INLINE pointer oblist_find_by_name(Lax *sc, const char *name)
   pointer x;
   char *s;
 
-  location = hash_fn(name, ivalue_unchecked(sc->oblist));
+  location = hash_fn(name, veclen(sc->oblist));
   for (x = vector_elem(sc->oblist, location); x != sc->NIL; x = cdr(x)) {
     s = symname(car(x));
     if(stricmp(name, s) == 0) {
@@ -808,7 +1653,7 @@ static pointer oblist_all_symbols(Lax *sc)
   pointer x;
   pointer ob_list = sc->NIL;
 
-  for (i = 0; i < ivalue_unchecked(sc->oblist); i++) {
+  for (i = 0; i < veclen(sc->oblist); i++) {
     for (x  = vector_elem(sc->oblist, i); x != sc->NIL; x = cdr(x)) {
       ob_list = cons(sc, x, ob_list);
     }
@@ -871,7 +1716,11 @@ pointer mk_foreign_func(Lax *sc, foreign_func f) {
 }
 
 INTERFACE pointer mk_character(Lax *sc, int c) {
-  pointer x = get_cell(sc,sc->NIL, sc->NIL);
+  pointer x;
+#if USE_IMMEDIATES
+  return mk_imm_char(c);
+#endif
+  x = get_cell(sc,sc->NIL, sc->NIL);
 
   typeflag(x) = (T_CHARACTER | T_ATOM);
   ivalue_unchecked(x)= c;
@@ -880,7 +1729,13 @@ INTERFACE pointer mk_character(Lax *sc, int c) {
 }
 
 INTERFACE pointer mk_integer(Lax *sc, long num) {
-  pointer x = get_cell(sc,sc->NIL, sc->NIL);
+  pointer x;
+#if USE_IMMEDIATES
+  if(fits_imm_fixnum(num)) {
+    return mk_imm_fixnum(num);
+  }
+#endif
+  x = get_cell(sc,sc->NIL, sc->NIL);
 
   typeflag(x) = (T_NUMBER | T_ATOM);
   ivalue_unchecked(x)= num;
@@ -905,92 +1760,915 @@ static pointer mk_number(Lax *sc, num n) {
  }
 }
 
-static char *store_string(Lax *sc, int len_str, const char *str, char fill) {
-     char *q;
+/* Bignums: exact integers outside the range of long.  The magnitude is
+   kept in 32-bit limbs, least significant first, and the cell stores the
+   limb count, negated for negative numbers.  Results that fit a long are
+   always returned as fixnums, so a bignum is never in fixnum range. */
+typedef unsigned int limb;
+typedef unsigned long long dlimb;
+#define LIMB_BITS        32
+#define FIX_LIMBS        (sizeof(unsigned long)/sizeof(limb))
+
+/* a sign and magnitude not (yet) owned by a cell */
+typedef struct big {
+     int neg;
+     size_t n;
+     limb *d;
+} big;
+
+static size_t mag_norm(const limb *d, size_t n) {
+     while (n > 0 && d[n-1] == 0)
+          n--;
+     return n;
+}
 
-     q=(char*)sc->malloc(len_str+1);
-     if(q==0) {
-          sc->no_memory=1;
-          return sc->strbuff;
+static int mag_cmp(const limb *a, size_t an, const limb *b, size_t bn) {
+     if (an != bn)
+          return an < bn ? -1 : 1;
+     while (an-- > 0) {
+          if (a[an] != b[an])
+               return a[an] < b[an] ? -1 : 1;
      }
-     if(str!=0) {
-          snprintf(q, len_str+1, "%s", str);
-     } else {
-          memset(q, fill, len_str);
-          q[len_str]=0;
+     return 0;
+}
+
+/* r[0..an] = a + b, an >= bn */
+static void mag_add(limb *r, const limb *a, size_t an, const limb *b, size_t bn) {
+     dlimb c = 0;
+     size_t i;
+     for (i = 0; i < bn; i++) {
+          c += (dlimb)a[i] + b[i];
+          r[i] = (limb)c;
+          c >>= LIMB_BITS;
      }
-     return (q);
+     for (; i < an; i++) {
+          c += a[i];
+          r[i] = (limb)c;
+          c >>= LIMB_BITS;
+     }
+     r[i] = (limb)c;
 }
 
-INTERFACE pointer mk_string(Lax *sc, const char *str) {
-     return mk_counted_string(sc,str,strlen(str));
+/* r[0..rn) += a[0..an), an <= rn */
+static void mag_add_into(limb *r, size_t rn, const limb *a, size_t an) {
+     dlimb c = 0;
+     size_t i;
+     for (i = 0; i < an; i++) {
+          c += (dlimb)r[i] + a[i];
+          r[i] = (limb)c;
+          c >>= LIMB_BITS;
+     }
+     for (; c != 0 && i < rn; i++) {
+          c += r[i];
+          r[i] = (limb)c;
+          c >>= LIMB_BITS;
+     }
 }
 
-INTERFACE pointer mk_counted_string(Lax *sc, const char *str, int len) {
-     pointer x = get_cell(sc, sc->NIL, sc->NIL);
-     typeflag(x) = (T_STRING | T_ATOM);
-     strvalue(x) = store_string(sc,len,str,0);
-     strlength(x) = len;
-     return (x);
+/* r[0..an) = a - b, a >= b; r may be a */
+static void mag_sub(limb *r, const limb *a, size_t an, const limb *b, size_t bn) {
+     dlimb t;
+     limb br = 0;
+     size_t i;
+     for (i = 0; i < bn; i++) {
+          t = (dlimb)a[i] - b[i] - br;
+          r[i] = (limb)t;
+          br = (limb)(t >> LIMB_BITS) & 1;
+     }
+     for (; i < an; i++) {
+          t = (dlimb)a[i] - br;
+          r[i] = (limb)t;
+          br = (limb)(t >> LIMB_BITS) & 1;
+     }
 }
 
-INTERFACE pointer mk_empty_string(Lax *sc, int len, char fill) {
-     pointer x = get_cell(sc, sc->NIL, sc->NIL);
-     typeflag(x) = (T_STRING | T_ATOM);
-     strvalue(x) = store_string(sc,len,0,fill);
-     strlength(x) = len;
-     return (x);
+/* r[0..an+bn) = a * b */
+static void mag_mul_school(limb *r, const limb *a, size_t an, const limb *b, size_t bn) {
+     size_t i, j;
+     memset(r, 0, (an+bn)*sizeof(limb));
+     for (i = 0; i < an; i++) {
+          dlimb c = 0;
+          for (j = 0; j < bn; j++) {
+               c += (dlimb)a[i]*b[j] + r[i+j];
+               r[i+j] = (limb)c;
+               c >>= LIMB_BITS;
+          }
+          r[i+bn] = (limb)c;
+     }
 }
 
-INTERFACE static pointer mk_vector(Lax *sc, int len)
-{ return get_vector_object(sc,len,sc->NIL); }
+static size_t kara_scratch(size_t n) {
+     size_t h = n - n/2;
+     if (n < KARATSUBA_MIN)
+          return 0;
+     return 4*(h+1) + kara_scratch(h+1);
+}
 
-INTERFACE static void fill_vector(pointer vec, pointer obj) {
-     int i;
-     int num=ivalue(vec)/2+ivalue(vec)%2;
-     for(i=0; i<num; i++) {
-          typeflag(vec+1+i) = T_PAIR;
-          setimmutable(vec+1+i);
-          car(vec+1+i)=obj;
-          cdr(vec+1+i)=obj;
+/* r[0..2n) = a[0..n) * b[0..n), with kara_scratch(n) limbs at t.
+   a = a1*B^m + a0, and the middle product comes from
+   (a0+a1)*(b0+b1) - a0*b0 - a1*b1. */
+static void mag_mul_kara(limb *r, const limb *a, const limb *b, size_t n, limb *t) {
+     size_t m = n/2, h = n - m;
+     limb *sa = t, *sb = t + (h+1), *z1 = t + 2*(h+1);
+     if (n < KARATSUBA_MIN) {
+          mag_mul_school(r, a, n, b, n);
+          return;
+     }
+     mag_mul_kara(r, a, b, m, t);
+     mag_mul_kara(r + 2*m, a + m, b + m, h, t);
+     mag_add(sa, a + m, h, a, m);
+     mag_add(sb, b + m, h, b, m);
+     mag_mul_kara(z1, sa, sb, h+1, t + 4*(h+1));
+     mag_sub(z1, z1, 2*(h+1), r, 2*m);
+     mag_sub(z1, z1, 2*(h+1), r + 2*m, 2*h);
+     mag_add_into(r + m, m + 2*h, z1, mag_norm(z1, 2*(h+1)));
+}
+
+/* r[0..an+bn) = a * b; Karatsuba on bn-limb slices once both sides are
+   long enough.  0 when out of memory. */
+static int mag_mul(Lax *sc, limb *r, const limb *a, size_t an, const limb *b, size_t bn) {
+     limb *t, *p;
+     size_t i, k;
+     if (an < bn) {
+          const limb *s = a;
+          a = b;
+          b = s;
+          k = an;
+          an = bn;
+          bn = k;
+     }
+     if (bn < KARATSUBA_MIN) {
+          mag_mul_school(r, a, an, b, bn);
+          return 1;
      }
+     t = (limb*)sc->malloc((kara_scratch(bn) + 2*bn)*sizeof(limb));
+     if (t == 0)
+          return 0;
+     p = t + kara_scratch(bn);
+     memset(r, 0, (an+bn)*sizeof(limb));
+     for (i = 0; i < an; i += bn) {
+          k = an - i < bn ? an - i : bn;
+          if (k == bn) {
+               mag_mul_kara(p, a + i, b, bn, t);
+          } else {
+               mag_mul_school(p, b, bn, a + i, k);
+          }
+          mag_add_into(r + i, an + bn - i, p, k + bn);
+     }
+     sc->free(t);
+     return 1;
 }
 
-INTERFACE static pointer vector_elem(pointer vec, int ielem) {
-     int n=ielem/2;
-     if(ielem%2==0) {
-          return car(vec+1+n);
-     } else {
-          return cdr(vec+1+n);
+/* q[0..n) = a / d, returns a % d; q may be a */
+static limb mag_divmod1(limb *q, const limb *a, size_t n, limb d) {
+     dlimb r = 0;
+     while (n-- > 0) {
+          r = (r << LIMB_BITS) | a[n];
+          q[n] = (limb)(r / d);
+          r %= d;
+     }
+     return (limb)r;
+}
+
+/* q[0..an-bn] = a / b and r[0..bn) = a % b, for an >= bn >= 2 and b
+   normalized (Knuth, algorithm D).  0 when out of memory. */
+static int mag_divmod(Lax *sc, limb *q, limb *r, const limb *a, size_t an, const limb *b, size_t bn) {
+     limb *u, *v;
+     int s = 0;
+     size_t i, j;
+
+     u = (limb*)sc->malloc((an+1+bn)*sizeof(limb));
+     if (u == 0)
+          return 0;
+     v = u + an + 1;
+     while (((b[bn-1] << s) & 0x80000000U) == 0)
+          s++;
+     for (i = bn-1; i > 0; i--)
+          v[i] = s ? (b[i] << s) | (b[i-1] >> (LIMB_BITS-s)) : b[i];
+     v[0] = b[0] << s;
+     u[an] = s ? a[an-1] >> (LIMB_BITS-s) : 0;
+     for (i = an-1; i > 0; i--)
+          u[i] = s ? (a[i] << s) | (a[i-1] >> (LIMB_BITS-s)) : a[i];
+     u[0] = a[0] << s;
+
+     for (j = an - bn + 1; j-- > 0; ) {
+          dlimb num = ((dlimb)u[j+bn] << LIMB_BITS) | u[j+bn-1];
+          dlimb qhat = num / v[bn-1];
+          dlimb rhat = num % v[bn-1];
+          long long t, k = 0;
+          while ((qhat >> LIMB_BITS) != 0
+                 || qhat*v[bn-2] > ((rhat << LIMB_BITS) | u[j+bn-2])) {
+               qhat--;
+               rhat += v[bn-1];
+               if ((rhat >> LIMB_BITS) != 0)
+                    break;
+          }
+          for (i = 0; i < bn; i++) {
+               dlimb p = qhat*v[i];
+               t = (long long)u[i+j] - k - (long long)(p & 0xFFFFFFFFU);
+               u[i+j] = (limb)t;
+               k = (long long)(p >> LIMB_BITS) - (t >> LIMB_BITS);
+          }
+          t = (long long)u[j+bn] - k;
+          u[j+bn] = (limb)t;
+          if (t < 0) {
+               dlimb c = 0;
+               qhat--;
+               for (i = 0; i < bn; i++) {
+                    c += (dlimb)u[i+j] + v[i];
+                    u[i+j] = (limb)c;
+                    c >>= LIMB_BITS;
+               }
+               u[j+bn] += (limb)c;
+          }
+          q[j] = (limb)qhat;
      }
+     for (i = 0; i < bn; i++)
+          r[i] = s ? (u[i] >> s) | (u[i+1] << (LIMB_BITS-s)) : u[i];
+     sc->free(u);
+     return 1;
 }
 
-INTERFACE static pointer set_vector_elem(pointer vec, int ielem, pointer a) {
-     int n=ielem/2;
-     if(ielem%2==0) {
-          return car(vec+1+n)=a;
+/* a op b for +, - and *; 0 on overflow */
+static int fix_arith(enum Lax_opcodes op, long a, long b, long *r) {
+#if defined(__GNUC__)
+     switch (op) {
+     case OP_ADD: return !__builtin_add_overflow(a, b, r);
+     case OP_SUB: return !__builtin_sub_overflow(a, b, r);
+     default:     return !__builtin_mul_overflow(a, b, r);
+     }
+#else
+     switch (op) {
+     case OP_ADD:
+          if ((b > 0 && a > LONG_MAX - b) || (b < 0 && a < LONG_MIN - b))
+               return 0;
+          *r = a + b;
+          return 1;
+     case OP_SUB:
+          if ((b < 0 && a > LONG_MAX + b) || (b > 0 && a < LONG_MIN + b))
+               return 0;
+          *r = a - b;
+          return 1;
+     default:
+          if (a > 0 ? (b > 0 ? a > LONG_MAX / b : b < LONG_MIN / a)
+                    : (b > 0 ? a < LONG_MIN / b : a != 0 && b < LONG_MAX / a))
+               return 0;
+          *r = a * b;
+          return 1;
+     }
+#endif
+}
+
+/* any exact integer as a big; fixnums borrow tmp[FIX_LIMBS] */
+static void big_view(pointer p, limb *tmp, big *b) {
+     if (is_bignum(p)) {
+          b->neg = bigsize(p) < 0;
+          b->n = bignlimbs(p);
+          b->d = biglimbs(p);
      } else {
-          return cdr(vec+1+n)=a;
+          long v = ivalue(p);
+          unsigned long m = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+          size_t i;
+          for (i = 0; i < FIX_LIMBS; i++) {
+               tmp[i] = (limb)m;
+               m = m >> (LIMB_BITS-1) >> 1;
+          }
+          b->neg = v < 0;
+          b->n = mag_norm(tmp, FIX_LIMBS);
+          b->d = tmp;
      }
 }
 
-INTERFACE pointer mk_symbol(Lax *sc, const char *name) {
+/* the integer -1^neg * d[0..n), as a fixnum when it fits */
+static pointer mk_bignum(Lax *sc, int neg, const limb *d, size_t n) {
      pointer x;
-
-     x = oblist_find_by_name(sc, name);
-     if (x != sc->NIL) {
-          return (x);
+     limb *l;
+
+     n = mag_norm(d, n);
+     if (n <= FIX_LIMBS) {
+          unsigned long m = 0;
+          size_t i;
+          for (i = n; i-- > 0; )
+               m = (m << (LIMB_BITS-1) << 1) | d[i];
+          if (!neg && m <= (unsigned long)LONG_MAX)
+               return mk_integer(sc, (long)m);
+          if (neg && m <= (unsigned long)LONG_MAX)
+               return mk_integer(sc, -(long)m);
+          if (neg && m == (unsigned long)LONG_MAX + 1)
+               return mk_integer(sc, LONG_MIN);
+     }
+     if (sc->large_bytes > sc->large_limit) {
+          gc_large(sc, sc->NIL, sc->NIL);
+     }
+     x = get_cell(sc, sc->NIL, sc->NIL);
+     if (sc->no_memory) { return sc->sink; }
+#if USE_HEAP_QUOTAS
+     if (!heap_quota(sc, n*sizeof(limb), 1)) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+#endif
+     l = (limb*)sc->malloc(n*sizeof(limb));
+     if (l == 0) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     memcpy(l, d, n*sizeof(limb));
+     typeflag(x) = (T_BIGNUM | T_ATOM);
+     biglimbs(x) = l;
+     bigsize(x) = neg ? -(long)n : (long)n;
+     sc->large_bytes += n*sizeof(limb);
+     return x;
+}
+
+static double big_rvalue(pointer p) {
+     double d = 0;
+     size_t i = bignlimbs(p);
+     while (i-- > 0)
+          d = d*4294967296.0 + biglimbs(p)[i];
+     return bigsize(p) < 0 ? -d : d;
+}
+
+/* exact a+b, or a-b when sub */
+static pointer big_add(Lax *sc, big *a, big *b, int sub) {
+     int bneg = b->neg ^ sub, neg;
+     size_t n = (a->n > b->n ? a->n : b->n) + 1;
+     limb *r = (limb*)sc->malloc(n*sizeof(limb));
+     pointer x;
+     if (r == 0) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     if (a->neg == bneg) {
+          neg = bneg;
+          if (a->n >= b->n)
+               mag_add(r, a->d, a->n, b->d, b->n);
+          else
+               mag_add(r, b->d, b->n, a->d, a->n);
+     } else if (mag_cmp(a->d, a->n, b->d, b->n) >= 0) {
+          neg = a->neg;
+          mag_sub(r, a->d, a->n, b->d, b->n);
+          n = a->n;
      } else {
-          x = oblist_add_by_name(sc, name);
-          return (x);
+          neg = bneg;
+          mag_sub(r, b->d, b->n, a->d, a->n);
+          n = b->n;
      }
+     x = mk_bignum(sc, neg, r, n);
+     sc->free(r);
+     return x;
 }
 
-INTERFACE pointer gensym(Lax *sc) {
+static pointer big_mul(Lax *sc, big *a, big *b) {
+     size_t n = a->n + b->n;
+     limb *r = (limb*)sc->malloc((n ? n : 1)*sizeof(limb));
      pointer x;
-     char name[40];
-
-     for(; sc->gensym_cnt<LONG_MAX; sc->gensym_cnt++) {
+     if (r == 0 || !mag_mul(sc, r, a->d, a->n, b->d, b->n)) {
+          if (r) sc->free(r);
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     x = mk_bignum(sc, a->neg ^ b->neg, r, n);
+     sc->free(r);
+     return x;
+}
+
+/* quotient, remainder or modulo of exact integers, b nonzero */
+static pointer big_divide(Lax *sc, enum Lax_opcodes op, big *a, big *b) {
+     size_t qn = a->n >= b->n ? a->n - b->n + 1 : 1;
+     limb *q = (limb*)sc->malloc((qn + b->n + a->n + 1)*sizeof(limb));
+     limb *r;
+     size_t rn = b->n;
+     pointer x;
+     if (q == 0) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     r = q + qn;
+     if (mag_cmp(a->d, a->n, b->d, b->n) < 0) {
+          q[0] = 0;
+          memcpy(r, a->d, a->n*sizeof(limb));
+          rn = a->n;
+     } else if (b->n == 1) {
+          r[0] = mag_divmod1(q, a->d, a->n, b->d[0]);
+     } else if (!mag_divmod(sc, q, r, a->d, a->n, b->d, b->n)) {
+          sc->free(q);
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     if (op == OP_INTDIV) {
+          x = mk_bignum(sc, a->neg ^ b->neg, q, qn);
+     } else if (op == OP_MOD && a->neg != b->neg && mag_norm(r, rn) != 0) {
+          mag_sub(r, b->d, b->n, r, rn);
+          x = mk_bignum(sc, b->neg, r, b->n);
+     } else {
+          x = mk_bignum(sc, a->neg, r, rn);
+     }
+     sc->free(q);
+     return x;
+}
+
+/* -1, 0 or 1 as a is below, equal to or above b; one is a bignum */
+static int big_cmp(pointer a, pointer b) {
+     limb ta[FIX_LIMBS], tb[FIX_LIMBS];
+     big x, y;
+     int c;
+     if (!num_is_integer(a) || !num_is_integer(b)) {
+          double da = rvalue(a), db = rvalue(b);
+          return da < db ? -1 : da > db;
+     }
+     big_view(a, ta, &x);
+     big_view(b, tb, &y);
+     if (x.n == 0 && y.n == 0)
+          return 0;
+     if (x.neg != y.neg)
+          return x.neg ? -1 : 1;
+     c = mag_cmp(x.d, x.n, y.d, y.n);
+     return x.neg ? -c : c;
+}
+
+/* exact a op b for +, - and *; fixnums take the overflow-checked path */
+static pointer int_arith(Lax *sc, enum Lax_opcodes op, pointer a, pointer b) {
+     limb ta[FIX_LIMBS], tb[FIX_LIMBS];
+     big x, y;
+     long r;
+     if (!is_bignum(a) && !is_bignum(b) && fix_arith(op, ivalue(a), ivalue(b), &r)) {
+          return mk_integer(sc, r);
+     }
+     big_view(a, ta, &x);
+     big_view(b, tb, &y);
+     switch (op) {
+     case OP_ADD:
+          return big_add(sc, &x, &y, 0);
+     case OP_SUB:
+          return big_add(sc, &x, &y, 1);
+     default:
+          return big_mul(sc, &x, &y);
+     }
+}
+
+/* +, - and * over an argument list.  All-integer lists accumulate in a
+   long until something overflows or a bignum shows up, then continue
+   exactly; any inexact argument makes the whole fold inexact. */
+static pointer arith_fold(Lax *sc, enum Lax_opcodes op, pointer args) {
+     pointer x, r;
+     num v;
+     long acc = (op == OP_MUL), t;
+
+     for (x = args; x != sc->NIL; x = cdr(x)) {
+          if (!num_is_integer(car(x)))
+               break;
+     }
+     if (x != sc->NIL) {
+          x = args;
+          if (op == OP_SUB && cdr(args) != sc->NIL) {
+               v = nvalue(car(args));
+               x = cdr(args);
+          } else {
+               v = op == OP_MUL ? num_one : num_zero;
+          }
+          for (; x != sc->NIL; x = cdr(x)) {
+               switch (op) {
+               case OP_ADD: v = num_add(v, nvalue(car(x))); break;
+               case OP_SUB: v = num_sub(v, nvalue(car(x))); break;
+               default:     v = num_mul(v, nvalue(car(x))); break;
+               }
+          }
+          return mk_number(sc, v);
+     }
+
+     x = args;
+     if (op == OP_SUB && cdr(args) != sc->NIL) {
+          if (is_bignum(car(args))) {
+               r = car(args);
+               x = cdr(args);
+               goto exact;
+          }
+          acc = ivalue(car(args));
+          x = cdr(args);
+     }
+     for (; x != sc->NIL; x = cdr(x)) {
+          if (is_bignum(car(x)) || !fix_arith(op, acc, ivalue(car(x)), &t))
+               break;
+          acc = t;
+     }
+     r = mk_integer(sc, acc);
+exact:
+     for (; x != sc->NIL && !sc->no_memory; x = cdr(x)) {
+          r = int_arith(sc, op, r, car(x));
+     }
+     return r;
+}
+
+/* quotient, remainder and modulo of two exact integers go through
+   int_divide when a bignum is involved or the fixnum result overflows */
+static int exact_divide(Lax *sc, pointer a, pointer rest) {
+     pointer b;
+     if (rest == sc->NIL || cdr(rest) != sc->NIL)
+          return 0;
+     b = car(rest);
+     if (!num_is_integer(a) || !num_is_integer(b))
+          return 0;
+     return is_bignum(a) || is_bignum(b) || (ivalue(a) == LONG_MIN && ivalue(b) == -1);
+}
+
+static pointer int_divide(Lax *sc, enum Lax_opcodes op, pointer a, pointer b) {
+     limb ta[FIX_LIMBS], tb[FIX_LIMBS];
+     big x, y;
+     big_view(a, ta, &x);
+     big_view(b, tb, &y);
+     return big_divide(sc, op, &x, &y);
+}
+
+static int big_compare(enum Lax_opcodes op, pointer a, pointer b) {
+     int c = big_cmp(a, b);
+     switch (op) {
+     case OP_NUMEQ: return c == 0;
+     case OP_LESS:  return c < 0;
+     case OP_GRE:   return c > 0;
+     case OP_LEQ:   return c <= 0;
+     default:       return c >= 0;
+     }
+}
+
+/* x^e for an exact integer x, by squaring */
+static pointer int_expt(Lax *sc, pointer x, long e) {
+     pointer r = mk_integer(sc, 1);
+     while (e > 0 && !sc->no_memory) {
+          if (e & 1)
+               r = int_arith(sc, OP_MUL, r, x);
+          e >>= 1;
+          if (e > 0)
+               x = int_arith(sc, OP_MUL, x, x);
+     }
+     return r;
+}
+
+/* digits of a bignum in base 2..16, as a fresh string cell */
+static pointer big_to_string(Lax *sc, pointer p, int base) {
+     size_t n = bignlimbs(p), len = (n*LIMB_BITS + 2 + sizeof(limb)-1) & ~(sizeof(limb)-1);
+     size_t pos = len;
+     limb chunk = base, *q;
+     int k = 1, i;
+     char *buf;
+     pointer s;
+
+     while ((dlimb)chunk*base <= 0xFFFFFFFFU) {
+          chunk *= base;
+          k++;
+     }
+     buf = (char*)sc->malloc(len + n*sizeof(limb));
+     if (buf == 0) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     q = (limb*)(buf + len);
+     memcpy(q, biglimbs(p), n*sizeof(limb));
+     while (n > 0) {
+          limb rem = mag_divmod1(q, q, n, chunk);
+          n = mag_norm(q, n);
+          for (i = 0; i < k && (n > 0 || rem != 0); i++) {
+               buf[--pos] = "0123456789abcdef"[rem % base];
+               rem /= base;
+          }
+     }
+     if (bigsize(p) < 0)
+          buf[--pos] = '-';
+     s = mk_counted_string(sc, buf + pos, len - pos);
+     sc->free(buf);
+     return s;
+}
+
+/* an integer literal of any length in base 2..16; #f if malformed */
+static pointer big_from_string(Lax *sc, const char *s, int base) {
+     int neg = 0;
+     size_t n = 0, len;
+     limb *d;
+     pointer x;
+
+     if (*s == '-' || *s == '+')
+          neg = (*s++ == '-');
+     len = strlen(s);
+     if (len == 0)
+          return sc->F;
+     d = (limb*)sc->malloc((len/8 + 2)*sizeof(limb));
+     if (d == 0) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     for (; *s; s++) {
+          int c = tolower((unsigned char)*s);
+          dlimb carry;
+          size_t i;
+          c = isdigit(c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : base;
+          if (c >= base) {
+               sc->free(d);
+               return sc->F;
+          }
+          carry = c;
+          for (i = 0; i < n; i++) {
+               carry += (dlimb)d[i]*base;
+               d[i] = (limb)carry;
+               carry >>= LIMB_BITS;
+          }
+          if (carry != 0)
+               d[n++] = (limb)carry;
+     }
+     x = mk_bignum(sc, neg, d, n);
+     sc->free(d);
+     return x;
+}
+
+#if USE_MATH
+/* an integral double as an exact integer */
+static pointer big_from_double(Lax *sc, double d) {
+     limb l[(DBL_MAX_EXP + LIMB_BITS - 1)/LIMB_BITS];
+     int neg = d < 0, e;
+     size_t n, i;
+     d = fabs(d);
+     frexp(d, &e);
+     n = e > 0 ? (size_t)(e + LIMB_BITS - 1)/LIMB_BITS : 1;
+     for (i = n; i-- > 0; ) {
+          double w = ldexp(1.0, (int)i*LIMB_BITS);
+          double h = floor(d / w);
+          l[i] = (limb)h;
+          d -= h*w;
+     }
+     return mk_bignum(sc, neg, l, n);
+}
+#endif
+
+static void fill_string(char *q, int len_str, const char *str, char fill) {
+     if(str!=0) {
+          memcpy(q, str, len_str);
+     } else {
+          memset(q, fill, len_str);
+     }
+     q[len_str]=0;
+}
+
+static char *store_string(Lax *sc, int len_str, const char *str, char fill) {
+     char *q;
+
+     q=(char*)sc->malloc(len_str+1);
+     if(q==0) {
+          sc->no_memory=1;
+          return sc->strbuff;
+     }
+     fill_string(q, len_str, str, fill);
+     return (q);
+}
+
+#if USE_STRING_SLABS
+/* Buffers of up to STR_SLAB_MAX bytes are blocks of a power-of-two size
+   class, cut from slabs of STR_SLAB_BYTES that live as long as the
+   interpreter.  A dead block goes on the free list of its class, so
+   releasing one is cheap enough to do right in the sweep. */
+#define STR_SLAB_MAX     (1L<<(STR_MIN_SHIFT+STR_SLAB_CLASSES-1))
+#define STR_SLAB_HDR     16
+
+static char *str_block(Lax *sc, int c) {
+     char *b = sc->str_free[c];
+
+     if(b==0) {
+          long size = 1L<<(STR_MIN_SHIFT+c);
+          char *slab = (char*)sc->malloc(STR_SLAB_BYTES);
+          long off;
+          if(slab==0) {
+               return 0;
+          }
+          *(char**)slab = sc->str_slabs;
+          sc->str_slabs = slab;
+          for(off = STR_SLAB_BYTES-size; off >= STR_SLAB_HDR; off -= size) {
+               *(char**)(slab+off) = b;
+               b = slab+off;
+          }
+     }
+     sc->str_free[c] = *(char**)b;
+     return b;
+}
+
+/* a block goes back on its list; 0 for a buffer from sc->malloc */
+static int str_unblock(Lax *sc, char *s) {
+     long c = strbuf_class(s);
+     char *b = (char*)strbuf_base(s);
+
+     if(c<0) {
+          return 0;
+     }
+     *(char**)b = sc->str_free[c];
+     sc->str_free[c] = b;
+     return 1;
+}
+#endif
+
+/* Heap string buffers carry a reference count in front of the data so
+   that substrings can share them; string-set! copies before writing.
+   With USE_HEAP_QUOTAS the bytes charged to the quota precede that,
+   and with USE_STRING_SLABS the size class of the block. */
+static char *alloc_strbuf(Lax *sc, int len) {
+     size_t n = STRBUF_HDR*sizeof(long)+len+1;
+     long *q;
+#if USE_STRING_SLABS
+     long c = 0;
+#endif
+
+#if USE_HEAP_QUOTAS
+     if(!heap_quota(sc, n, 1)) {
+          sc->no_memory=1;
+          return 0;
+     }
+#endif
+#if USE_STRING_SLABS
+     if(n <= (size_t)STR_SLAB_MAX) {
+          while(((size_t)1<<(STR_MIN_SHIFT+c)) < n) {
+               c++;
+          }
+          q=(long*)str_block(sc, (int)c);
+     } else {
+          c = -1;
+          q=(long*)sc->malloc(n);
+     }
+     if(q==0) {
+          sc->no_memory=1;
+          return 0;
+     }
+     *q++=c;
+#else
+     q=(long*)sc->malloc(n);
+     if(q==0) {
+          sc->no_memory=1;
+          return 0;
+     }
+#endif
+#if USE_HEAP_QUOTAS
+     *q++=(long)n;
+     sc->str_bytes += n;
+#endif
+     *q=1;
+     return (char*)(q+1);
+}
+
+static void release_strbuf(Lax *sc, char *s) {
+     if(--strbuf_refs(s)==0) {
+#if USE_HEAP_QUOTAS
+          sc->str_bytes -= strbuf_bytes(s);
+#endif
+#if USE_STRING_SLABS
+          if(str_unblock(sc, s))
+               return;
+#endif
+          sc->free(strbuf_base(s));
+     }
+}
+
+static pointer mk_string_cell(Lax *sc, int len, const char *str, char fill) {
+     pointer x = get_cell(sc, sc->NIL, sc->NIL);
+     char *q = 0;
+     if(len>STR_INLINE_MAX) {
+          q = alloc_strbuf(sc,len);
+          if(q==0) {
+               len = 0;
+          }
+     }
+     if(q==0) {
+          typeflag(x) = (T_STRING | T_ATOM | T_INLINE);
+          fill_string(strinline(x), len, str, fill);
+          strinline(x)[STR_INLINE_MAX+1] = (char)len;
+     } else {
+          typeflag(x) = (T_STRING | T_ATOM);
+          fill_string(q, len, str, fill);
+          strbuf(x) = q;
+          x->_object._string._length = len;
+          x->_object._string._offset = 0;
+     }
+     return (x);
+}
+
+static pointer mk_substring(Lax *sc, pointer s, int start, int len) {
+     pointer x;
+     if(len<=STR_INLINE_MAX || is_inline_string(s)) {
+          return mk_counted_string(sc,strvalue(s)+start,len);
+     }
+     x = get_cell(sc, sc->NIL, sc->NIL);
+     typeflag(x) = (T_STRING | T_ATOM);
+     strbuf(x) = strbuf(s);
+     x->_object._string._length = len;
+     x->_object._string._offset = s->_object._string._offset+start;
+     strbuf_refs(strbuf(x))++;
+     return (x);
+}
+
+static void string_detach(Lax *sc, pointer p) {
+     int len = strlength(p);
+     char *q = alloc_strbuf(sc,len);
+     if(q==0) {
+          return;
+     }
+     fill_string(q, len, strvalue(p), 0);
+     if(is_inline_string(p)) {
+          typeflag(p) &= ~T_INLINE;
+          p->_object._string._length = len;
+     } else {
+          release_strbuf(sc, strbuf(p));
+     }
+     strbuf(p) = q;
+     p->_object._string._offset = 0;
+}
+
+static char *string_writable(Lax *sc, pointer p) {
+     if(!is_inline_string(p) && strbuf_refs(strbuf(p))>1) {
+          string_detach(sc,p);
+     }
+     return strvalue(p);
+}
+
+static char *string_cstr(Lax *sc, pointer p) {
+     if(strvalue(p)[strlength(p)]!=0) {
+          string_detach(sc,p);
+          if(strvalue(p)[strlength(p)]!=0) {
+               return "";
+          }
+     }
+     return strvalue(p);
+}
+
+INTERFACE pointer mk_string(Lax *sc, const char *str) {
+     return mk_counted_string(sc,str,strlen(str));
+}
+
+INTERFACE pointer mk_counted_string(Lax *sc, const char *str, int len) {
+     return mk_string_cell(sc,len,str,0);
+}
+
+INTERFACE pointer mk_empty_string(Lax *sc, int len, char fill) {
+     return mk_string_cell(sc,len,0,fill);
+}
+
+INTERFACE static pointer mk_vector(Lax *sc, int len)
+{ return get_vector_object(sc,len,sc->NIL); }
+
+INTERFACE static void fill_vector(Lax *sc, pointer vec, pointer obj) {
+     size_t i;
+     size_t num=veclen(vec)/2+veclen(vec)%2;
+     gc_barrier(sc,vec,obj);
+     if(vecelems(vec)) {
+          for(i=0; i<veclen(vec); i++) {
+               vecelems(vec)[i]=obj;
+          }
+          return;
+     }
+     for(i=0; i<num; i++) {
+          typeflag(vec+1+i) = T_PAIR;
+          if(is_mark(vec)) {
+               setmark(vec+1+i);
+          }
+          setimmutable(vec+1+i);
+          car(vec+1+i)=obj;
+          cdr(vec+1+i)=obj;
+     }
+}
+
+INTERFACE static pointer vector_elem(pointer vec, int ielem) {
+     int n=ielem/2;
+     if(vecelems(vec)) {
+          return vecelems(vec)[ielem];
+     } else if(ielem%2==0) {
+          return car(vec+1+n);
+     } else {
+          return cdr(vec+1+n);
+     }
+}
+
+INTERFACE static pointer set_vector_elem(Lax *sc, pointer vec, int ielem, pointer a) {
+     int n=ielem/2;
+     gc_barrier(sc,vec,a);
+     if(vecelems(vec)) {
+          return vecelems(vec)[ielem]=a;
+     } else if(ielem%2==0) {
+          return car(vec+1+n)=a;
+     } else {
+          return cdr(vec+1+n)=a;
+     }
+}
+
+INTERFACE pointer mk_symbol(Lax *sc, const char *name) {
+     pointer x;
+
+     x = oblist_find_by_name(sc, name);
+     if (x != sc->NIL) {
+          return (x);
+     } else {
+          x = oblist_add_by_name(sc, name);
+          return (x);
+     }
+}
+
+INTERFACE pointer gensym(Lax *sc) {
+     pointer x;
+     char name[40];
+
+     for(; sc->gensym_cnt<LONG_MAX; sc->gensym_cnt++) {
           snprintf(name,40,"gensym-%ld",sc->gensym_cnt);
 
           x = oblist_find_by_name(sc, name);
@@ -1067,155 +2745,816 @@ static pointer mk_atom(Lax *sc, char *q) {
      if(has_dec_point) {
           return mk_real(sc,atof(q));
      }
+     if(p-q >= (long)(sizeof(long)*CHAR_BIT*3/10)) {
+          return big_from_string(sc, q, 10);
+     }
      return (mk_integer(sc, atol(q)));
 }
 
-static pointer mk_sharp_const(Lax *sc, char *name) {
-     long    x;
-     char    tmp[STRBUFFSIZE];
+static pointer mk_sharp_const(Lax *sc, char *name) {
+     long    x;
+     char    tmp[STRBUFFSIZE];
+
+     if (!strcmp(name, "t"))
+          return (sc->T);
+     else if (!strcmp(name, "f"))
+          return (sc->F);
+     else if (*name == 'o') {
+          snprintf(tmp, STRBUFFSIZE, "0%s", name+1);
+          sscanf(tmp, "%lo", (long unsigned *)&x);
+          return (mk_integer(sc, x));
+     } else if (*name == 'd') {
+          sscanf(name+1, "%ld", (long int *)&x);
+          return (mk_integer(sc, x));
+     } else if (*name == 'x') {
+          snprintf(tmp, STRBUFFSIZE, "0x%s", name+1);
+          sscanf(tmp, "%lx", (long unsigned *)&x);
+          return (mk_integer(sc, x));
+     } else if (*name == 'b') {
+          x = binary_decode(name+1);
+          return (mk_integer(sc, x));
+     } else if (*name == '\\') {
+          int c=0;
+          if(stricmp(name+1,"space")==0) {
+               c=' ';
+          } else if(stricmp(name+1,"newline")==0) {
+               c='\n';
+          } else if(stricmp(name+1,"return")==0) {
+               c='\r';
+          } else if(stricmp(name+1,"tab")==0) {
+               c='\t';
+     } else if(name[1]=='x' && name[2]!=0) {
+          int c1=0;
+          if(sscanf(name+2,"%x",(unsigned int *)&c1)==1 && c1 < UCHAR_MAX) {
+               c=c1;
+          } else {
+               return sc->NIL;
+     }
+#if USE_ASCII_NAMES
+          } else if(is_ascii_name(name+1,&c)) {
+#endif
+          } else if(name[2]==0) {
+               c=name[1];
+          } else {
+               return sc->NIL;
+          }
+          return mk_character(sc,c);
+     } else
+          return (sc->NIL);
+}
+
+#if defined(__GNUC__)
+# define prefetch(p)     __builtin_prefetch(p)
+#else
+# define prefetch(p)     ((void)0)
+#endif
+
+/* Cells waiting to be scanned.  The stack starts in mark()'s frame and
+   moves to malloc when it fills; mark() may run inside a write barrier,
+   where there is no Lax to take sc->malloc from. */
+struct mark_stack {
+     pointer *p;
+     size_t top, size;
+     pointer local[MARK_STACK_LOCAL];
+};
+
+static void mark_push(struct mark_stack *ms, pointer q) {
+     if (q == 0 || is_immediate(q)) {
+          return;
+     }
+     if (ms->top == ms->size) {
+          size_t n = 2*ms->size;
+          pointer *st = (pointer*)malloc(n*sizeof(pointer));
+          if (st == 0) {
+               mark(q);         /* out of room: recurse instead */
+               return;
+          }
+          memcpy(st, ms->p, ms->top*sizeof(pointer));
+          if (ms->p != ms->local) {
+               free(ms->p);
+          }
+          ms->p = st;
+          ms->size = n;
+     }
+     ms->p[ms->top++] = q;
+}
+
+/* push the children of a marked cell */
+static void mark_scan(struct mark_stack *ms, pointer p) {
+     if(has_slots(p)) {
+          size_t i, n = veclen(p);
+          if(vecelems(p)) {
+               for(i=0; i<n; i++) {
+                    mark_push(ms, vecelems(p)[i]);
+               }
+          } else {
+               for(i=0; i<n/2+n%2; i++) {
+                    setmark(p+1+i);
+                    mark_push(ms, car(p+1+i));
+                    mark_push(ms, cdr(p+1+i));
+               }
+          }
+     } else if(is_hashtable(p)) {
+          mark_hashtable(ms, p->_object._hash);
+     } else if(is_weakbox(p)) {
+          mark_push(ms, cdr(p));
+     }
+     if(!is_atom(p)) {
+          mark_push(ms, cdr(p));
+          mark_push(ms, car(p));
+     }
+}
+
+/* Mark a and everything it reaches; a itself is scanned even if it is
+   marked already.  A cell popped off the stack is prefetched and waits
+   in a ring of MARK_PREFETCH others before it is examined, which gives
+   the load time to arrive. */
+static void mark(pointer a) {
+     struct mark_stack ms;
+     pointer ring[MARK_PREFETCH];
+     pointer p, q;
+     int k = 0, waiting = 0;
+
+     if(is_immediate(a))
+          return;
+     ms.p = ms.local;
+     ms.top = 0;
+     ms.size = MARK_STACK_LOCAL;
+     memset(ring, 0, sizeof(ring));
+     setmark(a);
+     mark_scan(&ms, a);
+     for (;;) {
+          if (ms.top > 0) {
+               q = ms.p[--ms.top];
+               prefetch(q);
+               waiting++;
+          } else if (waiting > 0) {
+               q = 0;
+          } else {
+               break;
+          }
+          p = ring[k];
+          ring[k] = q;
+          k = (k + 1) % MARK_PREFETCH;
+          if (p == 0) {
+               continue;
+          }
+          waiting--;
+          if (!is_mark(p)) {
+               setmark(p);
+               mark_scan(&ms, p);
+          }
+     }
+     if (ms.p != ms.local) {
+          free(ms.p);
+     }
+}
+
+/* every root, plus a and b, which the caller still holds */
+static void gc_roots(Lax *sc, pointer a, pointer b,
+                     void (*visit)(void *, pointer), void *ctx) {
+  int i;
+
+  visit(ctx, sc->oblist);
+  visit(ctx, sc->global_env);
+
+  visit(ctx, sc->args);
+  visit(ctx, sc->envir);
+  visit(ctx, sc->code);
+#ifdef USE_Lax_STACK
+  visit(ctx, sc->dump);
+#else
+  dump_stack_visit(sc, visit, ctx);
+#endif
+  visit(ctx, sc->value);
+#if USE_HEAP_QUOTAS
+#ifdef USE_Lax_STACK
+  visit(ctx, sc->quota_dump);
+#endif
+  visit(ctx, sc->quota_envir);
+#endif
+  for (i = 0; i < sc->nvalues && i < MAX_VALUES; i++) {
+    visit(ctx, sc->values[i]);
+  }
+  visit(ctx, sc->values_more);
+  visit(ctx, sc->inport);
+  visit(ctx, sc->save_inport);
+  visit(ctx, sc->outport);
+  visit(ctx, sc->loadport);
+
+  for (i = 0; i < sc->nrecent; i++) {
+    visit(ctx, sc->recent[i]);
+  }
+  visit(ctx, sc->c_nest);
+
+  visit(ctx, a);
+  visit(ctx, b);
+}
+
+static void mark_root(void *ctx, pointer p) {
+  mark(p);
+}
+
+#if USE_PARALLEL_MARK
+/* Parallel marking.  A marker claims a cell by setting its mark bit
+   with an atomic or, so each cell is scanned by exactly one marker,
+   and keeps the cells it claimed but has not scanned on a private
+   stack.  When that stack grows it moves a chunk to its public slot,
+   where idle markers steal it.  The markers never write to cells, so
+   unlike mark() they can share the heap.  Their buffers come from
+   malloc, which unlike a custom sc->malloc is known to be thread safe.
+   A marker that cannot grow its stack leaves the cell unclaimed and
+   sets overflow; gc_par_mark() then repairs the marks serially. */
+
+#define MARK_CHUNK 128
+
+struct par_mark;
+
+struct marker {
+  pointer *stack;
+  long top, size;
+  pthread_mutex_t lock;
+  pointer pub[MARK_CHUNK];
+  int npub;
+  struct par_mark *pm;
+  pthread_t thread;
+};
+
+struct par_mark {
+  struct marker *m;
+  int n;
+  int active;           /* markers not looking for work */
+  int overflow;
+};
+
+static int par_reserve(struct marker *w, long k) {
+  if (w->top + k > w->size) {
+    long n = w->size ? 2*w->size : 4096;
+    pointer *st;
+    while (n < w->top + k) {
+      n *= 2;
+    }
+    st = (pointer*)realloc(w->stack, n*sizeof(pointer));
+    if (st == 0) {
+      w->pm->overflow = 1;
+      return 0;
+    }
+    w->stack = st;
+    w->size = n;
+  }
+  return 1;
+}
+
+static void par_push(struct marker *w, pointer p) {
+  uint64_t *word, bit;
+
+  if (p == 0 || is_immediate(p)) {
+    return;
+  }
+  word = &mark_word(p);
+  bit = mark_bit(p);
+  if ((__atomic_load_n(word, __ATOMIC_RELAXED) & bit) || !par_reserve(w, 1)) {
+    return;
+  }
+  if (!(__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit)) {
+    w->stack[w->top++] = p;
+  }
+}
+
+static void par_root(void *ctx, pointer p) {
+  par_push((struct marker*)ctx, p);
+}
+
+static void par_push_hashtable(struct marker *w, struct hashtab *h);
+
+/* the children mark() would visit */
+static void par_scan(struct marker *w, pointer p) {
+  if (has_slots(p)) {
+    size_t i, n = veclen(p);
+    if (vecelems(p)) {
+      for (i = 0; i < n; i++) {
+        par_push(w, vecelems(p)[i]);
+      }
+    } else {
+      for (i = 0; i < n/2+n%2; i++) {
+        __atomic_fetch_or(&mark_word(p+1+i), mark_bit(p+1+i), __ATOMIC_RELAXED);
+      }
+      for (i = 0; i < n; i++) {
+        par_push(w, vector_elem(p, i));
+      }
+    }
+  } else if (is_hashtable(p)) {
+    par_push_hashtable(w, p->_object._hash);
+  } else if (is_weakbox(p)) {
+    par_push(w, cdr(p));
+  }
+  if (!is_atom(p)) {
+    par_push(w, car(p));
+    par_push(w, cdr(p));
+  }
+}
+
+static void par_publish(struct marker *w) {
+  if (w->top > 2*MARK_CHUNK && __atomic_load_n(&w->npub, __ATOMIC_ACQUIRE) == 0) {
+    pthread_mutex_lock(&w->lock);
+    w->top -= MARK_CHUNK;
+    memcpy(w->pub, w->stack + w->top, MARK_CHUNK*sizeof(pointer));
+    __atomic_store_n(&w->npub, MARK_CHUNK, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&w->lock);
+  }
+}
+
+/* take a published chunk, looking at our own slot first */
+static int par_steal(struct marker *w) {
+  struct par_mark *pm = w->pm;
+  int i, k;
+
+  for (i = 0; i < pm->n; i++) {
+    struct marker *v = &pm->m[((w - pm->m) + i) % pm->n];
+    if (__atomic_load_n(&v->npub, __ATOMIC_ACQUIRE) == 0) {
+      continue;
+    }
+    pthread_mutex_lock(&v->lock);
+    k = v->npub;
+    if (k > 0) {
+      if (par_reserve(w, k)) {
+        memcpy(w->stack + w->top, v->pub, k*sizeof(pointer));
+        w->top += k;
+      } else {
+        k = 0;          /* dropped; the repair pass finds them */
+      }
+      __atomic_store_n(&v->npub, 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&v->lock);
+    if (k > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int par_any_pub(struct par_mark *pm) {
+  int i;
+  for (i = 0; i < pm->n; i++) {
+    if (__atomic_load_n(&pm->m[i].npub, __ATOMIC_ACQUIRE) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Only a busy marker publishes work, so once none is busy and no slot
+   holds a chunk, marking is done. */
+static void *par_run(void *arg) {
+  struct marker *w = (struct marker*)arg;
+  struct par_mark *pm = w->pm;
+
+  for (;;) {
+    while (w->top > 0) {
+      par_scan(w, w->stack[--w->top]);
+      par_publish(w);
+    }
+    if (par_steal(w)) {
+      continue;
+    }
+    __atomic_sub_fetch(&pm->active, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+      if (par_any_pub(pm)) {
+        __atomic_add_fetch(&pm->active, 1, __ATOMIC_SEQ_CST);
+        if (par_steal(w)) {
+          break;
+        }
+        __atomic_sub_fetch(&pm->active, 1, __ATOMIC_SEQ_CST);
+      } else if (__atomic_load_n(&pm->active, __ATOMIC_SEQ_CST) == 0) {
+        return 0;
+      }
+      sched_yield();
+    }
+  }
+}
+
+/* 0 when the heap is too small to be worth the threads */
+static int gc_par_mark(Lax *sc, pointer a, pointer b) {
+  struct marker m[MAX_MARK_THREADS];
+  struct par_mark pm;
+  int i, n = sc->gc_threads;
+  pointer p;
+
+  if (n > MAX_MARK_THREADS) {
+    n = MAX_MARK_THREADS;
+  }
+  if (n < 2 || (sc->last_cell_seg + 1) * CELL_SEGSIZE < GC_PAR_MIN_CELLS) {
+    return 0;
+  }
+  pm.m = m;
+  pm.n = n;
+  pm.active = n;
+  pm.overflow = 0;
+  for (i = 0; i < n; i++) {
+    m[i].stack = 0;
+    m[i].top = m[i].size = 0;
+    m[i].npub = 0;
+    m[i].pm = &pm;
+    pthread_mutex_init(&m[i].lock, 0);
+  }
+  gc_roots(sc, a, b, par_root, &m[0]);
+  for (i = 1; i < pm.n; i++) {
+    if (pthread_create(&m[i].thread, 0, par_run, &m[i]) != 0) {
+      __atomic_sub_fetch(&pm.active, pm.n - i, __ATOMIC_SEQ_CST);
+      pm.n = i;
+      break;
+    }
+  }
+  par_run(&m[0]);
+  for (i = 1; i < pm.n; i++) {
+    pthread_join(m[i].thread, 0);
+  }
+  for (i = 0; i < n; i++) {
+    pthread_mutex_destroy(&m[i].lock);
+    free(m[i].stack);
+  }
+  if (pm.overflow) {
+    gc_roots(sc, a, b, mark_root, 0);
+    for (i = sc->last_cell_seg; i >= 0; i--) {
+      for (p = sc->cell_seg[i]; p < sc->cell_seg[i] + CELL_SEGSIZE; p++) {
+        if (typeflag(p) != 0 && is_mark(p)) {
+          mark(p);
+        }
+      }
+    }
+  }
+  return 1;
+}
+
+void Lax_set_gc_threads(Lax *sc, int n) {
+  sc->gc_threads = n;
+}
+#endif
+
+static void gc_mark_roots(Lax *sc, pointer a, pointer b) {
+#if USE_PARALLEL_MARK
+  if (!gc_par_mark(sc, a, b))
+#endif
+  gc_roots(sc, a, b, mark_root, 0);
+  gc_weak(sc);
+  clrmark(sc->NIL);
+}
+
+/* an unmarked cell found by the sweep */
+static INLINE void sweep_free(Lax *sc, pointer p) {
+  if (typeflag(p) != 0) {
+    finalize_cell(sc, p);
+    typeflag(p) = 0;
+    car(p) = sc->NIL;
+  }
+  ++sc->fcells;
+#if !USE_GENERATIONAL_GC
+  cdr(p) = sc->free_cell;
+  sc->free_cell = p;
+#endif
+}
+
+#if USE_LAZY_SWEEP
+/* Lazy sweeping.  gc() only marks; the sweep then runs down the heap
+   from the last segment as the allocator needs cells, handing freed
+   cells straight out, so everything above sweep_ptr is swept and cells
+   taken from the free list never meet the sweep again.  A cell that was
+   marked stays marked until the sweep passes it. */
+
+static void gc_sweep_begin(Lax *sc) {
+  sc->gc_phase = GC_SWEEP;
+  sc->sweep_seg = sc->last_cell_seg;
+  sc->sweep_ptr = sc->cell_seg[sc->sweep_seg] + CELL_SEGSIZE;
+  sc->free_cell = sc->NIL;
+  sc->fcells = 0;
+  sc->sweep_freed = 0;
+}
+
+static void gc_sweep_done(Lax *sc) {
+#if USE_INCREMENTAL_GC
+  long cells, want;
+#endif
+
+  sc->gc_phase = GC_IDLE;
+  gc_release_flush(sc);
+  sc->large_limit = 2*sc->large_bytes;
+  if (sc->large_limit < LARGE_GC_MIN) {
+    sc->large_limit = LARGE_GC_MIN;
+  }
+  if (sc->gc_verbose) {
+    char msg[80];
+    snprintf(msg,80,"done: %ld cells are free.\n", sc->fcells);
+    putstr(sc,msg);
+  }
+  /* a squeeze is there to shrink the heap, not to grow it */
+  if (heap_squeezing(sc)) {
+    return;
+  }
+#if USE_INCREMENTAL_GC
+  /* keep half the heap free so the next cycle can finish in time */
+  cells = (sc->last_cell_seg + 1) * CELL_SEGSIZE;
+  want = cells/2 - sc->fcells;
+  if (want > 0) {
+    if (heap_quota_segs(sc, want / CELL_SEGSIZE + 1)) {
+      alloc_cellseg(sc, (int)(want / CELL_SEGSIZE) + 1);
+    } else if (sc->fcells < cells/4) {
+      /* as in _get_cell: the next allocation fails with the quota error */
+      sc->no_memory = 1;
+    }
+  }
+#else
+  if (heap_short(sc, sc->sweep_freed) && !grow_heap(sc)
+      && heap_over_quota(sc)) {
+    /* as in _get_cell: the next allocation fails with the quota error */
+    sc->no_memory = 1;
+  }
+#endif
+}
+
+static void gc_sweep_some(Lax *sc, long n) {
+  pointer p = sc->sweep_ptr;
+  pointer base = sc->cell_seg[sc->sweep_seg];
+
+  while (n-- > 0) {
+    if (p == base) {
+      if (sc->sweep_seg == 0) {
+        gc_sweep_done(sc);
+        return;
+      }
+      base = sc->cell_seg[--sc->sweep_seg];
+      p = base + CELL_SEGSIZE;
+    }
+    --p;
+    if (is_mark(p)) {
+      clrmark(p);
+    } else {
+      sweep_free(sc, p);
+      sc->sweep_freed++;
+    }
+  }
+  sc->sweep_ptr = p;
+}
+
+/* sweep until the free list has a cell or the sweep is done */
+static void gc_sweep_for_cell(Lax *sc) {
+  while (sc->free_cell == sc->NIL && sc->gc_phase == GC_SWEEP) {
+    gc_sweep_some(sc, CELL_SEGSIZE);
+  }
+}
+
+/* the same for n consecutive cells */
+static pointer gc_sweep_for_run(Lax *sc, int n) {
+  pointer x;
+
+  while (sc->gc_phase == GC_SWEEP) {
+    gc_sweep_some(sc, CELL_SEGSIZE);
+    x = find_consecutive_cells(sc, n);
+    if (x != sc->NIL) {
+      return x;
+    }
+  }
+  return sc->NIL;
+}
+#endif
 
-     if (!strcmp(name, "t"))
-          return (sc->T);
-     else if (!strcmp(name, "f"))
-          return (sc->F);
-     else if (*name == 'o') {
-          snprintf(tmp, STRBUFFSIZE, "0%s", name+1);
-          sscanf(tmp, "%lo", (long unsigned *)&x);
-          return (mk_integer(sc, x));
-     } else if (*name == 'd') {
-          sscanf(name+1, "%ld", (long int *)&x);
-          return (mk_integer(sc, x));
-     } else if (*name == 'x') {
-          snprintf(tmp, STRBUFFSIZE, "0x%s", name+1);
-          sscanf(tmp, "%lx", (long unsigned *)&x);
-          return (mk_integer(sc, x));
-     } else if (*name == 'b') {
-          x = binary_decode(name+1);
-          return (mk_integer(sc, x));
-     } else if (*name == '\\') {
-          int c=0;
-          if(stricmp(name+1,"space")==0) {
-               c=' ';
-          } else if(stricmp(name+1,"newline")==0) {
-               c='\n';
-          } else if(stricmp(name+1,"return")==0) {
-               c='\r';
-          } else if(stricmp(name+1,"tab")==0) {
-               c='\t';
-     } else if(name[1]=='x' && name[2]!=0) {
-          int c1=0;
-          if(sscanf(name+2,"%x",(unsigned int *)&c1)==1 && c1 < UCHAR_MAX) {
-               c=c1;
-          } else {
-               return sc->NIL;
-     }
-#if USE_ASCII_NAMES
-          } else if(is_ascii_name(name+1,&c)) {
+#if USE_INCREMENTAL_GC
+/* Incremental collection.  A cycle shades the roots, then marks in
+   slices of at most gc_pause_us from Eval_Cycle, between opcodes, where
+   every cell handed out is fully built.  Marked cells on the gray stack
+   still have their children to be shaded; cells allocated meanwhile go
+   on it unmarked and are scanned when popped.  With the gray stack empty
+   the roots are marked once more, since the mutator moves pointers
+   between them freely, and the lazy sweep starts. */
+
+static long gc_usec(void) {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long)ts.tv_sec*1000000L + ts.tv_nsec/1000;
+#else
+  return (long)((double)clock()*1000000.0/CLOCKS_PER_SEC);
 #endif
-          } else if(name[2]==0) {
-               c=name[1];
-          } else {
-               return sc->NIL;
-          }
-          return mk_character(sc,c);
-     } else
-          return (sc->NIL);
 }
 
-static void mark(pointer a) {
-     pointer t, q, p;
+static int gray_push(Lax *sc, pointer p) {
+  if (sc->gray_top == sc->gray_size) {
+    long n = sc->gray_size ? 2*sc->gray_size : 1024;
+    pointer *g = (pointer*)sc->malloc(n*sizeof(pointer));
+    if (g == 0) {
+      return 0;
+    }
+    if (sc->gray != 0) {
+      memcpy(g, sc->gray, sc->gray_top*sizeof(pointer));
+      sc->free(sc->gray);
+    }
+    sc->gray = g;
+    sc->gray_size = n;
+  }
+  sc->gray[sc->gray_top++] = p;
+  return 1;
+}
 
-     t = (pointer) 0;
-     p = a;
-E2:  setmark(p);
-     if(is_vector(p)) {
-          int i;
-          int num=ivalue_unchecked(p)/2+ivalue_unchecked(p)%2;
-          for(i=0; i<num; i++) {
-               mark(p+1+i);
-          }
-     }
-     if (is_atom(p))
-          goto E6;
-     q = car(p);
-     if (q && !is_mark(q)) {
-          setatom(p);
-          car(p) = t;
-          t = p;
-          p = q;
-          goto E2;
-     }
-E5:  q = cdr(p);
-     if (q && !is_mark(q)) {
-          cdr(p) = t;
-          t = p;
-          p = q;
-          goto E2;
-     }
-E6:
-     if (!t)
-          return;
-     q = t;
-     if (is_atom(q)) {
-          clratom(q);
-          t = car(q);
-          car(q) = p;
-          p = q;
-          goto E5;
-     } else {
-          t = cdr(q);
-          cdr(q) = p;
-          p = q;
-          goto E6;
-     }
+static void gc_shade(Lax *sc, pointer p) {
+  if (p != 0 && !is_mark(p)) {
+    setmark(p);
+    if (!gray_push(sc, p)) {
+      mark(p);
+    }
+  }
 }
 
-static void gc(Lax *sc, pointer a, pointer b) {
-  pointer p;
-  int i;
+static void gc_scan(Lax *sc, pointer p) {
+  if (typeflag(p) == 0) {
+    return;     /* handed out but not built yet */
+  }
+  setmark(p);
+  if (has_slots(p)) {
+    size_t i, n = veclen(p);
+    if (vecelems(p)) {
+      for (i = 0; i < n; i++) {
+        gc_shade(sc, vecelems(p)[i]);
+      }
+    } else {
+      for (i = 0; i < n/2+n%2; i++) {
+        setmark(p+1+i);
+      }
+      for (i = 0; i < n; i++) {
+        gc_shade(sc, vector_elem(p, i));
+      }
+    }
+  } else if (is_hashtable(p)) {
+    shade_hashtable(sc, p->_object._hash);
+  } else if (is_weakbox(p)) {
+    gc_shade(sc, cdr(p));
+  }
+  if (!is_atom(p)) {
+    gc_shade(sc, car(p));
+    gc_shade(sc, cdr(p));
+  }
+}
+
+static void shade_root(void *ctx, pointer p) {
+  gc_shade((Lax*)ctx, p);
+}
 
+/* 1 once the gray stack is empty; deadline < 0 means no limit */
+static int gc_drain(Lax *sc, long deadline) {
+  long n = 0;
+
+  while (sc->gray_top > 0) {
+    gc_scan(sc, sc->gray[--sc->gray_top]);
+    if (deadline >= 0 && (++n & 255) == 0 && gc_usec() >= deadline) {
+      return sc->gray_top == 0;
+    }
+  }
+  return 1;
+}
+
+/* start a cycle, or hurry the one under way */
+static void gc_begin(Lax *sc) {
+  if (sc->gc_phase != GC_IDLE) {
+    sc->gc_debt += GC_STEP_CELLS;
+    return;
+  }
   if(sc->gc_verbose) {
-    putstr(sc, "gc...");
+    putstr(sc, "gc (incremental)...");
+  }
+  sc->gc_phase = GC_MARK;
+  sc->gc_debt = 0;
+  gc_roots(sc, sc->NIL, sc->NIL, shade_root, sc);
+}
+
+static void gc_sweep_start(Lax *sc) {
+  gc_mark_roots(sc, sc->NIL, sc->NIL);
+  gc_sweep_begin(sc);
+}
+
+/* one slice of work, called between opcodes */
+static void gc_step(Lax *sc) {
+  long deadline;
+
+  if (sc->gc_phase == GC_IDLE) {
+    gc_begin(sc);
+    return;
+  }
+  sc->gc_debt = 0;
+  deadline = gc_usec() + sc->gc_pause_us;
+  if (sc->gc_phase == GC_MARK) {
+    if (gc_drain(sc, deadline)) {
+      gc_sweep_start(sc);
+    }
+    return;
   }
+  do {
+    gc_sweep_some(sc, 1024);
+  } while (sc->gc_phase == GC_SWEEP && gc_usec() < deadline);
+}
 
-  mark(sc->oblist);
-  mark(sc->global_env);
+void Lax_set_gc_pause(Lax *sc, long usec) {
+  sc->gc_pause_us = usec;
+}
+#endif
 
-  mark(sc->args);
-  mark(sc->envir);
-  mark(sc->code);
-  dump_stack_mark(sc);
-  mark(sc->value);
-  mark(sc->inport);
-  mark(sc->save_inport);
-  mark(sc->outport);
-  mark(sc->loadport);
+#if USE_LAZY_SWEEP
+/* run the cycle under way to its end */
+static void gc_finish(Lax *sc) {
+#if USE_INCREMENTAL_GC
+  if (sc->gc_phase == GC_MARK) {
+    gc_drain(sc, -1);
+    sc->gc_phase = GC_IDLE;     /* gc() marks the roots and sweeps */
+  }
+#endif
+  if (sc->gc_phase == GC_SWEEP) {
+    gc_sweep_some(sc, LONG_MAX);
+  }
+}
+#endif
 
-  mark(car(sc->sink));
-  mark(sc->c_nest);
+static void gc(Lax *sc, pointer a, pointer b) {
+#if USE_LAZY_SWEEP
+  gc_finish(sc);
+#else
+  int i;
+#if !USE_GENERATIONAL_GC
+  int empty = 0;
+#endif
+#endif
+  if(sc->gc_verbose) {
+    putstr(sc, "gc...");
+  }
 
-  mark(a);
-  mark(b);
+#if USE_GENERATIONAL_GC
+  /* a full collection starts with every cell young again */
+  clear_marks(sc);
+#endif
+  gc_mark_roots(sc, a, b);
 
-  clrmark(sc->NIL);
+#if USE_LAZY_SWEEP
+  gc_sweep_begin(sc);
+#else
   sc->fcells = 0;
   sc->free_cell = sc->NIL;
   for (i = sc->last_cell_seg; i >= 0; i--) {
-    p = sc->cell_seg[i] + CELL_SEGSIZE;
+#if USE_HEAP_REGIONS
+    if (i < sc->old_segs) {
+      seg_unmark(sc->cell_seg[i]);     /* checkpoint cells all stay */
+      continue;
+    }
+#endif
+#if !USE_GENERATIONAL_GC
+    long before = sc->fcells;
+#endif
+#if USE_MARK_BITMAP
+    uint64_t *m = seg_marks(sc->cell_seg[i]);
+    pointer base = sc->cell_seg[i] - CELL_SEGHDR;
+    long w;
+    int bit;
+
+    for (w = MARK_WORDS - 1; w >= 0; w--) {
+      if (m[w] == ~(uint64_t)0) {
+        continue;       /* 64 live cells */
+      }
+      for (bit = 63; bit >= 0; bit--) {
+        if (!(m[w] >> bit & 1)) {
+          sweep_free(sc, base + 64*w + bit);
+        }
+      }
+    }
+#if !USE_GENERATIONAL_GC
+    seg_clear_marks(m);
+#endif
+#else
+    pointer p = sc->cell_seg[i] + CELL_SEGSIZE;
+
     while (--p >= sc->cell_seg[i]) {
       if (is_mark(p)) {
+#if !USE_GENERATIONAL_GC
     clrmark(p);
+#endif
       } else {
-        if (typeflag(p) != 0) {
-          finalize_cell(sc, p);
-          typeflag(p) = 0;
-          car(p) = sc->NIL;
-        }
-        ++sc->fcells;
-        cdr(p) = sc->free_cell;
-        sc->free_cell = p;
+        sweep_free(sc, p);
       }
     }
+#endif
+#if !USE_GENERATIONAL_GC
+    if (sc->fcells - before == CELL_SEGSIZE) {
+      car(sc->cell_seg[i]) = sc->T;     /* for release_cellsegs */
+      empty++;
+    }
+#endif
+  }
+#if USE_GENERATIONAL_GC
+  gen_reset(sc);
+#else
+  if (empty > 0) {
+    release_cellsegs(sc, empty);
+  }
+#endif
+  gc_release_flush(sc);
+
+  sc->large_limit = 2*sc->large_bytes;
+  if (sc->large_limit < LARGE_GC_MIN) {
+    sc->large_limit = LARGE_GC_MIN;
   }
 
   if (sc->gc_verbose) {
@@ -1223,17 +3562,319 @@ static void gc(Lax *sc, pointer a, pointer b) {
     snprintf(msg,80,"done: %ld cells were recovered.\n", sc->fcells);
     putstr(sc,msg);
   }
+#endif
+}
+
+#if USE_HEAP_QUOTAS
+/* The aggressive collection of the soft limit: everything is swept at
+   once and every empty segment is returned.  The next one is due when
+   the footprint has grown by half again. */
+static void gc_squeeze(Lax *sc, pointer a, pointer b) {
+  size_t fp;
+
+  sc->quota_gc = 0;
+  sc->squeezing = 1;
+  gc(sc, a, b);
+#if USE_LAZY_SWEEP
+  gc_finish(sc);
+#endif
+  sc->squeezing = 0;
+  fp = heap_footprint(sc);
+  sc->quota_trigger = fp + fp/2 > sc->soft_limit ? fp + fp/2 : sc->soft_limit;
+  if (sc->quota_trigger > sc->hard_limit) {
+    sc->quota_trigger = sc->hard_limit;
+  }
+}
+
+/* Whether the footprint may grow by extra bytes.  Where a collection
+   is not safe it is left for the next opcode.  A refusal is raised as
+   an error by Eval_Cycle; the handler of that error may go over the
+   hard limit by an eighth until it returns. */
+static int heap_quota(Lax *sc, size_t extra, int can_gc) {
+  size_t want = heap_footprint(sc) + extra;
+
+  if (want <= sc->quota_trigger) {
+    return 1;
+  }
+  if (can_gc) {
+    gc_squeeze(sc, sc->NIL, sc->NIL);
+    want = heap_footprint(sc) + extra;
+  } else {
+    sc->quota_gc = 1;
+  }
+  if (want <= sc->hard_limit) {
+    sc->over_quota = 0;
+    return 1;
+  }
+  if (sc->quota_grace && want - sc->hard_limit <= sc->hard_limit/8) {
+    return 1;
+  }
+  sc->over_quota = 1;
+  return 0;
+}
+
+/* 0 for no limit; without a soft limit the hard one collects first */
+void Lax_set_heap_limits(Lax *sc, size_t soft, size_t hard) {
+  sc->hard_limit = hard ? hard : (size_t)-1;
+  sc->soft_limit = soft && soft < sc->hard_limit ? soft : sc->hard_limit;
+  sc->quota_trigger = sc->soft_limit;
+}
+
+size_t Lax_heap_bytes(Lax *sc) {
+  return heap_footprint(sc);
+}
+#endif
+
+#if USE_GENERATIONAL_GC
+/* Old cells are already marked, so marking from the roots only visits
+   young ones; the survivors keep their mark and are old from now on.
+   Only the nursery segments are swept.  When old cells crowd out the
+   free space, or old large objects outgrow large_limit, a full
+   collection follows. */
+static void gc_minor(Lax *sc, pointer a, pointer b) {
+  pointer p;
+  long freed = 0;
+  int i = sc->gen_first;
+
+  if(sc->gc_verbose) {
+    putstr(sc, "gc (minor)...");
+  }
+
+  gc_mark_roots(sc, a, b);
+  for (;;) {
+    for (p = sc->cell_seg[i]; p < sc->cell_seg[i] + CELL_SEGSIZE; p++) {
+      if (typeflag(p) != 0 && !is_mark(p)) {
+        finalize_cell(sc, p);
+        typeflag(p) = 0;
+        car(p) = sc->NIL;
+        ++freed;
+      }
+    }
+    if (i == sc->gen_seg) {
+      break;
+    }
+    i = i < sc->last_cell_seg ? i + 1 : 0;
+  }
+  sc->fcells += freed;
+  gen_reset(sc);
+  gc_release_flush(sc);
+
+  if (sc->gc_verbose) {
+    char msg[80];
+    snprintf(msg,80,"done: %ld cells were recovered.\n", freed);
+    putstr(sc,msg);
+  }
+
+  if (sc->fcells < (sc->last_cell_seg + 1) * CELL_SEGSIZE / 8
+      || sc->large_bytes > sc->large_limit) {
+    gen_full(sc, a, b);
+  }
+}
+#endif
+
+#if USE_FINALIZER_THREAD
+/* Background finalization.  The sweep still decides what is dead and
+   drops string buffer references, but the free() and fclose() calls
+   for dead payloads are collected in batches and run by a finalizer
+   thread, outside the pause.  free() is only known to be thread safe
+   when it is the allocator in use, so a custom sc->free is called
+   directly as before. */
+
+struct fin_item {
+  void *buf;
+  FILE *file;
+};
+
+struct fin_batch {
+  struct fin_batch *next;
+  int n;
+  struct fin_item item[GC_FIN_BATCH];
+};
+
+struct finalizer {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  int running;
+  int stop;
+  struct fin_batch *queue;      /* handed over, not yet released */
+  struct fin_batch *batch;      /* being filled by the sweep */
+};
+
+static void fin_run_batch(struct fin_batch *b) {
+  int i;
+  for (i = 0; i < b->n; i++) {
+    if (b->item[i].file) {
+      fclose(b->item[i].file);
+    }
+    free(b->item[i].buf);
+  }
+  free(b);
+}
+
+static void *fin_thread(void *arg) {
+  struct finalizer *f = (struct finalizer*)arg;
+  struct fin_batch *b;
+
+  pthread_mutex_lock(&f->lock);
+  for (;;) {
+    while (f->queue == 0 && !f->stop) {
+      pthread_cond_wait(&f->cond, &f->lock);
+    }
+    if (f->queue == 0) {
+      break;
+    }
+    b = f->queue;
+    f->queue = 0;
+    pthread_mutex_unlock(&f->lock);
+    while (b != 0) {
+      struct fin_batch *next = b->next;
+      fin_run_batch(b);
+      b = next;
+    }
+    pthread_mutex_lock(&f->lock);
+  }
+  pthread_mutex_unlock(&f->lock);
+  return 0;
+}
+
+static void fin_init(Lax *sc) {
+  struct finalizer *f;
+
+  sc->fin = 0;
+  if (sc->free != free || (f = (struct finalizer*)malloc(sizeof *f)) == 0) {
+    return;
+  }
+  pthread_mutex_init(&f->lock, 0);
+  pthread_cond_init(&f->cond, 0);
+  f->running = 0;
+  f->stop = 0;
+  f->queue = f->batch = 0;
+  sc->fin = f;
+}
+
+/* wait for everything handed over, and end the thread */
+static void fin_deinit(Lax *sc) {
+  struct finalizer *f = sc->fin;
+
+  if (f == 0) {
+    return;
+  }
+  gc_release_flush(sc);
+  if (f->running) {
+    pthread_mutex_lock(&f->lock);
+    f->stop = 1;
+    pthread_cond_signal(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    pthread_join(f->thread, 0);
+  }
+  pthread_cond_destroy(&f->cond);
+  pthread_mutex_destroy(&f->lock);
+  free(f);
+  sc->fin = 0;
+}
+#endif
+
+/* release a dead payload: buf is freed, file closed */
+static void gc_release(Lax *sc, void *buf, FILE *file) {
+#if USE_FINALIZER_THREAD
+  struct finalizer *f = sc->fin;
+
+  if (f != 0) {
+    struct fin_batch *b = f->batch;
+    if (b == 0 || b->n == GC_FIN_BATCH) {
+      if (b != 0) {
+        gc_release_flush(sc);
+      }
+      b = (struct fin_batch*)malloc(sizeof *b);
+      if (b != 0) {
+        b->n = 0;
+        f->batch = b;
+      }
+    }
+    if (b != 0) {
+      b->item[b->n].buf = buf;
+      b->item[b->n].file = file;
+      b->n++;
+      return;
+    }
+  }
+#endif
+  if (file) {
+    fclose(file);
+  }
+  if (buf) {
+    sc->free(buf);
+  }
+}
+
+/* hand the releases gathered so far to the finalizer */
+static void gc_release_flush(Lax *sc) {
+#if USE_FINALIZER_THREAD
+  struct finalizer *f = sc->fin;
+  struct fin_batch *b;
+
+  if (f == 0 || (b = f->batch) == 0) {
+    return;
+  }
+  f->batch = 0;
+  if (!f->running) {
+    if (pthread_create(&f->thread, 0, fin_thread, f) != 0) {
+      fin_run_batch(b);
+      return;
+    }
+    f->running = 1;
+  }
+  pthread_mutex_lock(&f->lock);
+  b->next = f->queue;
+  f->queue = b;
+  pthread_cond_signal(&f->cond);
+  pthread_mutex_unlock(&f->lock);
+#endif
+}
+
+static void finalize_strbuf(Lax *sc, char *s) {
+  if(--strbuf_refs(s)==0) {
+#if USE_HEAP_QUOTAS
+    sc->str_bytes -= strbuf_bytes(s);
+#endif
+#if USE_STRING_SLABS
+    if(str_unblock(sc, s))
+      return;
+#endif
+    gc_release(sc, strbuf_base(s), 0);
+  }
 }
 
 static void finalize_cell(Lax *sc, pointer a) {
   if(is_string(a)) {
-    sc->free(strvalue(a));
+    if(!is_inline_string(a))
+      finalize_strbuf(sc, strbuf(a));
   } else if(is_port(a)) {
-    if(a->_object._port->kind&port_file
-       && a->_object._port->rep.stdio.closeit) {
-      port_close(sc,a,port_input|port_output);
+    port *pt=a->_object._port;
+    if(pt->kind&port_file && pt->rep.stdio.closeit) {
+#if SHOW_ERROR_LINE
+      if(pt->rep.stdio.filename)
+        gc_release(sc, pt->rep.stdio.filename, 0);
+#endif
+      gc_release(sc, pt, pt->rep.stdio.file);
+    } else {
+      if(pt->kind&port_string && pt->rep.string.buf) {
+        finalize_strbuf(sc, pt->rep.string.buf);
+      }
+      gc_release(sc, pt, 0);
     }
-    sc->free(a->_object._port);
+  } else if(has_slots(a) && vecelems(a)) {
+    sc->large_bytes -= veclen(a)*sizeof(pointer);
+    gc_release(sc, vecelems(a), 0);
+  } else if(is_hashtable(a)) {
+    free_hashtable(sc, a->_object._hash);
+  } else if(is_numvector(a)) {
+    sc->large_bytes -= numvec_len(a)*numvec_esize(a);
+    gc_release(sc, numvec_raw(a), 0);
+  } else if(is_bignum(a)) {
+    sc->large_bytes -= bignlimbs(a)*sizeof(limb);
+    gc_release(sc, biglimbs(a), 0);
   }
 }
 
@@ -1282,6 +3923,10 @@ static port *port_rep_from_filename(Lax *sc, const char *fn, int prop) {
     rw="a+";
   } else if(prop==port_output) {
     rw="w";
+  } else if(prop==(port_output|port_binary)) {
+    rw="wb";
+  } else if(prop==(port_input|port_binary)) {
+    rw="rb";
   } else {
     rw="r";
   }
@@ -1343,6 +3988,7 @@ static port *port_rep_from_string(Lax *sc, char *start, char *past_the_end, int
   pt->rep.string.start=start;
   pt->rep.string.curr=start;
   pt->rep.string.past_the_end=past_the_end;
+  pt->rep.string.buf=0;
   return pt;
 }
 
@@ -1355,6 +4001,23 @@ static pointer port_from_string(Lax *sc, char *start, char *past_the_end, int pr
   return mk_port(sc,pt);
 }
 
+/* the port shares the string's buffer, so it outlives the string cell */
+static pointer port_from_string_cell(Lax *sc, pointer s, int prop) {
+  pointer p;
+  if(is_inline_string(s)) {
+    string_detach(sc,s);
+    if(is_inline_string(s)) {
+      return sc->NIL;
+    }
+  }
+  p=port_from_string(sc,strvalue(s),strvalue(s)+strlength(s),prop);
+  if(p!=sc->NIL) {
+    p->_object._port->rep.string.buf=strbuf(s);
+    strbuf_refs(strbuf(s))++;
+  }
+  return p;
+}
+
 #define BLOCK_SIZE 256
 
 static port *port_rep_from_scratch(Lax *sc) {
@@ -1374,6 +4037,7 @@ static port *port_rep_from_scratch(Lax *sc) {
   pt->rep.string.start=start;
   pt->rep.string.curr=start;
   pt->rep.string.past_the_end=start+BLOCK_SIZE-1;
+  pt->rep.string.buf=0;
   return pt;
 }
 
@@ -1400,6 +4064,9 @@ static void port_close(Lax *sc, pointer p, int flag) {
 #endif
 
       fclose(pt->rep.stdio.file);
+    } else if(pt->kind&port_string && pt->rep.string.buf) {
+      release_strbuf(sc,pt->rep.string.buf);
+      pt->rep.string.buf=0;
     }
     pt->kind=port_free;
   }
@@ -1450,12 +4117,13 @@ static void backchar(Lax *sc, int c) {
 static int realloc_port_string(Lax *sc, port *p)
 {
   char *start=p->rep.string.start;
-  size_t new_size=p->rep.string.past_the_end-start+1+BLOCK_SIZE;
+  size_t old_size=p->rep.string.past_the_end-start;
+  size_t new_size=old_size+1+(old_size>BLOCK_SIZE?old_size:BLOCK_SIZE);
   char *str=sc->malloc(new_size);
   if(str) {
     memset(str,' ',new_size-1);
     str[new_size-1]='\0';
-    strcpy(str,start);
+    memcpy(str,start,old_size);
     p->rep.string.start=str;
     p->rep.string.past_the_end=str+new_size-1;
     p->rep.string.curr-=start-str;
@@ -1509,6 +4177,45 @@ INTERFACE void putcharacter(Lax *sc, int c) {
   }
 }
 
+/* Block transfers for binary I/O: a single fread/fwrite for file ports,
+   memcpy for string ports. */
+static size_t port_read_block(port *pt, char *buf, size_t n) {
+  size_t avail;
+  if(pt->kind&port_file) {
+    return fread(buf,1,n,pt->rep.stdio.file);
+  }
+  avail=pt->rep.string.past_the_end-pt->rep.string.curr;
+  if(n>avail) {
+    n=avail;
+  }
+  memcpy(buf,pt->rep.string.curr,n);
+  pt->rep.string.curr+=n;
+  return n;
+}
+
+static size_t port_write_block(Lax *sc, port *pt, const char *buf, size_t n) {
+  size_t done=0, room;
+  if(pt->kind&port_file) {
+    return fwrite(buf,1,n,pt->rep.stdio.file);
+  }
+  while(done<n) {
+    room=pt->rep.string.past_the_end-pt->rep.string.curr;
+    if(room==0) {
+      if(!(pt->kind&port_srfi6) || !realloc_port_string(sc,pt)) {
+        break;
+      }
+      continue;
+    }
+    if(room>n-done) {
+      room=n-done;
+    }
+    memcpy(pt->rep.string.curr,buf+done,room);
+    pt->rep.string.curr+=room;
+    done+=room;
+  }
+  return done;
+}
+
 static char *readstr_upto(Lax *sc, char *delim) {
   char *p = sc->strbuff;
 
@@ -1814,13 +4521,20 @@ static void atom2str(Lax *sc, pointer l, int f, char **pp, int *plen) {
           p = "#f";
      } else if (l == sc->EOF_OBJ) {
           p = "#<EOF>";
+     } else if (l == sc->VALUES) {
+          p = "#<VALUES>";
      } else if (is_port(l)) {
           p = "#<PORT>";
+     } else if (is_bignum(l)) {
+          pointer s = big_to_string(sc, l, (f <= 1 || f == 10) ? 10 : f);
+          *pp = strvalue(s);
+          *plen = strlength(s);
+          return;
      } else if (is_number(l)) {
           p = sc->strbuff;
           if (f <= 1 || f == 10) {
               if(num_is_integer(l)) {
-                   snprintf(p, STRBUFFSIZE, "%ld", ivalue_unchecked(l));
+                   snprintf(p, STRBUFFSIZE, "%ld", ivalue(l));
               } else {
                    snprintf(p, STRBUFFSIZE, "%.10g", rvalue_unchecked(l));
                    f = strcspn(p, ".e");
@@ -1852,7 +4566,9 @@ static void atom2str(Lax *sc, pointer l, int f, char **pp, int *plen) {
           }
      } else if (is_string(l)) {
           if (!f) {
-               p = strvalue(l);
+               *pp=strvalue(l);
+               *plen=strlength(l);
+               return;
           } else {
                *pp=sc->strbuff;
                *plen=0;
@@ -1909,6 +4625,19 @@ static void atom2str(Lax *sc, pointer l, int f, char **pp, int *plen) {
           p = "#<CLOSURE>";
      } else if (is_promise(l)) {
           p = "#<PROMISE>";
+     } else if (is_hashtable(l)) {
+          p = "#<HASH-TABLE>";
+     } else if (is_weakbox(l)) {
+          p = "#<WEAK-BOX>";
+     } else if (is_guardian(l)) {
+          p = "#<GUARDIAN>";
+     } else if (is_record(l) || is_rectype(l)) {
+          pointer rtd = is_record(l) ? vector_elem(l,0) : l;
+          p = sc->strbuff;
+          snprintf(p,STRBUFFSIZE,"#<%s %s>", is_record(l) ? "RECORD" : "RECORD-TYPE",
+                   symname(vector_elem(rtd,0)));
+     } else if (is_recproc(l)) {
+          p = "#<RECORD PROCEDURE>";
      } else if (is_foreign(l)) {
           p = sc->strbuff;
           snprintf(p,STRBUFFSIZE,"#<FOREIGN PROCEDURE %ld>", procnum(l));
@@ -1917,111 +4646,960 @@ static void atom2str(Lax *sc, pointer l, int f, char **pp, int *plen) {
      } else {
           p = "#<ERROR>";
      }
-     *pp=p;
-     *plen=strlen(p);
+     *pp=p;
+     *plen=strlen(p);
+}
+
+static pointer mk_closure(Lax *sc, pointer c, pointer e) {
+     pointer x = get_cell(sc, c, e);
+
+     typeflag(x) = T_CLOSURE;
+     car(x) = c;
+     cdr(x) = e;
+     return (x);
+}
+
+static pointer mk_continuation(Lax *sc, pointer d) {
+     pointer x = get_cell(sc, sc->NIL, d);
+
+     typeflag(x) = T_CONTINUATION;
+     cont_dump(x) = d;
+     return (x);
+}
+
+static pointer list_star(Lax *sc, pointer d) {
+  pointer p, q;
+  if(cdr(d)==sc->NIL) {
+    return car(d);
+  }
+  p=cons(sc,car(d),cdr(d));
+  q=p;
+  while(cdr(cdr(p))!=sc->NIL) {
+    d=cons(sc,car(p),cdr(p));
+    if(cdr(cdr(p))!=sc->NIL) {
+      p=cdr(d);
+    }
+  }
+  gc_barrier(sc, p, car(cdr(p)));
+  cdr(p)=car(cdr(p));
+  return q;
+}
+
+static pointer reverse(Lax *sc, pointer a) {
+     pointer p = sc->NIL;
+
+     for ( ; is_pair(a); a = cdr(a)) {
+          p = cons(sc, car(a), p);
+     }
+     return (p);
+}
+
+static pointer reverse_in_place(Lax *sc, pointer term, pointer list) {
+     pointer p = list, result = term, q;
+
+     while (p != sc->NIL) {
+          q = cdr(p);
+          gc_barrier(sc, p, result);
+          cdr(p) = result;
+          result = p;
+          p = q;
+     }
+     return (result);
+}
+
+static pointer revappend(Lax *sc, pointer a, pointer b) {
+    pointer result = a;
+    pointer p = b;
+
+    while (is_pair(p)) {
+        result = cons(sc, car(p), result);
+        p = cdr(p);
+    }
+
+    if (p == sc->NIL) {
+        return result;
+    }
+
+    return sc->F;
+}
+
+int eqv(pointer a, pointer b) {
+     if (is_string(a)) {
+          if (is_string(b))
+               return (a == b);
+          else
+               return (0);
+     } else if (is_number(a)) {
+          if (is_bignum(a) || is_bignum(b)) {
+               return is_bignum(a) && is_bignum(b) && big_cmp(a, b) == 0;
+          }
+          if (is_number(b)) {
+               if (num_is_integer(a) == num_is_integer(b))
+                    return num_eq(nvalue(a),nvalue(b));
+          }
+          return (0);
+     } else if (is_character(a)) {
+          if (is_character(b))
+               return charvalue(a)==charvalue(b);
+          else
+               return (0);
+     } else if (is_port(a)) {
+          if (is_port(b))
+               return a==b;
+          else
+               return (0);
+     } else if (is_proc(a)) {
+          if (is_proc(b))
+               return procnum(a)==procnum(b);
+          else
+               return (0);
+     } else {
+          return (a == b);
+     }
+}
+
+static int equal(pointer a, pointer b) {
+     for (;;) {
+          if (a == b) {
+               return 1;
+          } else if (is_pair(a)) {
+               if (!is_pair(b) || !equal(car(a), car(b)))
+                    return 0;
+               a = cdr(a);
+               b = cdr(b);
+          } else if (is_string(a)) {
+               return is_string(b) && strlength(a) == strlength(b)
+                    && memcmp(strvalue(a), strvalue(b), strlength(a)) == 0;
+          } else if (is_vector(a)) {
+               size_t i;
+               if (!is_vector(b) || veclen(a) != veclen(b))
+                    return 0;
+               for (i = 0; i < veclen(a); i++) {
+                    if (!equal(vector_elem(a, i), vector_elem(b, i)))
+                         return 0;
+               }
+               return 1;
+          } else if (is_numvector(a)) {
+               return type(a) == type(b) && numvec_len(a) == numvec_len(b)
+                    && memcmp(numvec_data(a), numvec_data(b), numvec_len(a)*numvec_esize(a)) == 0;
+          } else {
+               return eqv(a, b);
+          }
+     }
+}
+
+/* Hash tables use open addressing with linear probing.  Growing keeps
+   the old slot arrays and drains HT_MIGRATE of them per operation, so
+   no single insert pays for a full rehash. */
+enum { HT_EQ, HT_EQV, HT_EQUAL, HT_STRING };
+/* how strongly a table holds its entries; see gc_weak() */
+enum { HT_STRONG, HT_WEAK_KEYS, HT_EPHEMERON };
+
+#define HT_MIN_SIZE  16
+#define HT_MIGRATE   16
+#define HT_HASH_DEPTH 4
+#define HT_MAX_SIZE  (SIZE_MAX/(4*sizeof(pointer)))  /* keeps slot bytes in a size_t */
+
+struct hashtab {
+  int kind;
+  int weak;
+  size_t count;
+  size_t size;
+  size_t used;
+  pointer *keys;
+  pointer *vals;
+  size_t old_size;
+  size_t old_pos;
+  pointer *old_keys;
+  pointer *old_vals;
+};
+
+static struct cell ht_deleted_cell;
+#define HT_DELETED (&ht_deleted_cell)
+#define ht_live(k)   ((k) != 0 && (k) != HT_DELETED)
+
+static size_t hash_mix(size_t x) {
+     x ^= x >> 16;
+     x *= 0x45d9f3bUL;
+     x ^= x >> 16;
+     x *= 0x45d9f3bUL;
+     x ^= x >> 16;
+     return x;
+}
+
+static size_t hash_bytes(const char *s, int len) {
+     size_t h = 2166136261UL;
+     int i;
+     for (i = 0; i < len; i++) {
+          h ^= (unsigned char)s[i];
+          h *= 16777619UL;
+     }
+     return h;
+}
+
+static size_t hash_eqv(pointer p) {
+     if (is_bignum(p)) {
+          return hash_bytes((const char*)biglimbs(p), bignlimbs(p)*sizeof(limb)) ^ (bigsize(p) < 0);
+     } else if (is_number(p)) {
+          double d;
+          if (num_is_integer(p))
+               return hash_mix((size_t)ivalue(p));
+          d = rvalue(p);
+          if (d == 0.0)
+               return 0;
+          return hash_bytes((const char*)&d, sizeof(d));
+     } else if (is_character(p)) {
+          return hash_mix((size_t)charvalue(p)) ^ 1;
+     } else if (is_proc(p)) {
+          return hash_mix((size_t)procnum(p)) ^ 2;
+     }
+     return hash_mix((size_t)p);
+}
+
+static size_t hash_equal(pointer p, int depth) {
+     if (is_string(p)) {
+          return hash_bytes(strvalue(p), strlength(p));
+     } else if (is_pair(p)) {
+          if (depth <= 0)
+               return 17;
+          return hash_equal(car(p), depth-1)*31 + hash_equal(cdr(p), depth-1);
+     } else if (is_vector(p)) {
+          size_t h = veclen(p), i;
+          for (i = 0; i < veclen(p) && i < HT_HASH_DEPTH && depth > 0; i++) {
+               h = h*31 + hash_equal(vector_elem(p, i), depth-1);
+          }
+          return h;
+     } else if (is_numvector(p)) {
+          return hash_bytes(numvec_data(p), numvec_len(p)*numvec_esize(p));
+     }
+     return hash_eqv(p);
+}
+
+static size_t ht_hash(struct hashtab *h, pointer key) {
+     switch (h->kind) {
+     case HT_EQ:
+          return hash_mix((size_t)key);
+     case HT_EQV:
+          return hash_eqv(key);
+     case HT_EQUAL:
+          return hash_equal(key, HT_HASH_DEPTH);
+     default:
+          return is_string(key) ? hash_bytes(strvalue(key), strlength(key)) : hash_eqv(key);
+     }
+}
+
+static int ht_same(struct hashtab *h, pointer a, pointer b) {
+     switch (h->kind) {
+     case HT_EQ:
+          return a == b;
+     case HT_EQV:
+          return eqv(a, b);
+     default:
+          return equal(a, b);
+     }
+}
+
+static long ht_probe(struct hashtab *h, pointer *keys, size_t size, pointer key, size_t hv) {
+     size_t i = hv & (size-1), n;
+     for (n = 0; n < size; n++) {
+          if (keys[i] == 0)
+               return -1;
+          if (keys[i] != HT_DELETED && ht_same(h, keys[i], key))
+               return (long)i;
+          i = (i+1) & (size-1);
+     }
+     return -1;
+}
+
+static void ht_put_new(struct hashtab *h, pointer key, pointer val, size_t hv) {
+     size_t i = hv & (h->size-1);
+     while (ht_live(h->keys[i])) {
+          i = (i+1) & (h->size-1);
+     }
+     if (h->keys[i] == 0)
+          h->used++;
+     h->keys[i] = key;
+     h->vals[i] = val;
+}
+
+static pointer *ht_alloc_slots(Lax *sc, size_t size) {
+     pointer *slots;
+     size_t i;
+     if (size > 2*HT_MAX_SIZE) {
+          sc->no_memory = 1;
+          return 0;
+     }
+     slots = (pointer*)sc->malloc(2*size*sizeof(pointer));
+     if (slots == 0) {
+          sc->no_memory = 1;
+          return 0;
+     }
+     for (i = 0; i < 2*size; i++) {
+          slots[i] = 0;
+     }
+     sc->large_bytes += 2*size*sizeof(pointer);
+     return slots;
+}
+
+static void ht_free_slots(Lax *sc, pointer *slots, size_t size) {
+     if (slots != 0) {
+          sc->large_bytes -= 2*size*sizeof(pointer);
+          sc->free(slots);
+     }
+}
+
+static void ht_migrate(Lax *sc, struct hashtab *h, size_t n) {
+     while (h->old_keys != 0 && n-- > 0) {
+          if (h->old_pos == h->old_size) {
+               ht_free_slots(sc, h->old_keys, h->old_size);
+               h->old_keys = h->old_vals = 0;
+               break;
+          }
+          if (ht_live(h->old_keys[h->old_pos])) {
+               pointer k = h->old_keys[h->old_pos];
+               ht_put_new(h, k, h->old_vals[h->old_pos], ht_hash(h, k));
+               h->old_keys[h->old_pos] = HT_DELETED;
+          }
+          h->old_pos++;
+     }
+}
+
+static int ht_grow(Lax *sc, struct hashtab *h) {
+     size_t size = HT_MIN_SIZE;
+     pointer *slots;
+
+     ht_migrate(sc, h, (size_t)-1);
+     while (size <= h->count*2) {
+          size *= 2;
+     }
+#if USE_HEAP_QUOTAS
+     if (!heap_quota(sc, 2*size*sizeof(pointer), 0)) {
+          sc->no_memory = 1;
+          return 0;
+     }
+#endif
+     slots = ht_alloc_slots(sc, size);
+     if (slots == 0)
+          return 0;
+     h->old_keys = h->keys;
+     h->old_vals = h->vals;
+     h->old_size = h->size;
+     h->old_pos = 0;
+     h->keys = slots;
+     h->vals = slots+size;
+     h->size = size;
+     h->used = 0;
+     return 1;
+}
+
+static pointer *ht_lookup(struct hashtab *h, pointer key) {
+     size_t hv = ht_hash(h, key);
+     long i = ht_probe(h, h->keys, h->size, key, hv);
+     if (i >= 0)
+          return &h->vals[i];
+     if (h->old_keys != 0) {
+          i = ht_probe(h, h->old_keys, h->old_size, key, hv);
+          if (i >= 0)
+               return &h->old_vals[i];
+     }
+     return 0;
+}
+
+static int ht_set(Lax *sc, struct hashtab *h, pointer key, pointer val) {
+     size_t hv;
+     long i;
+
+     ht_migrate(sc, h, HT_MIGRATE);
+     hv = ht_hash(h, key);
+     i = ht_probe(h, h->keys, h->size, key, hv);
+     if (i >= 0) {
+          h->vals[i] = val;
+          return 1;
+     }
+     if (h->old_keys != 0) {
+          i = ht_probe(h, h->old_keys, h->old_size, key, hv);
+          if (i >= 0) {
+               h->old_keys[i] = HT_DELETED;
+               h->count--;
+          }
+     }
+     if ((h->used+1)*4 > h->size*3 && !ht_grow(sc, h))
+          return 0;
+     ht_put_new(h, key, val, hv);
+     h->count++;
+     return 1;
+}
+
+static int ht_delete(Lax *sc, struct hashtab *h, pointer key) {
+     size_t hv;
+     long i;
+
+     ht_migrate(sc, h, HT_MIGRATE);
+     hv = ht_hash(h, key);
+     i = ht_probe(h, h->keys, h->size, key, hv);
+     if (i >= 0) {
+          h->keys[i] = HT_DELETED;
+          h->vals[i] = 0;
+          h->count--;
+          return 1;
+     }
+     if (h->old_keys != 0) {
+          i = ht_probe(h, h->old_keys, h->old_size, key, hv);
+          if (i >= 0) {
+               h->old_keys[i] = HT_DELETED;
+               h->count--;
+               return 1;
+          }
+     }
+     return 0;
+}
+
+static pointer mk_hashtable(Lax *sc, int kind, size_t hint) {
+     pointer x;
+     struct hashtab *h;
+     size_t size = HT_MIN_SIZE;
+
+     if (sc->large_bytes > sc->large_limit) {
+          gc_large(sc, sc->NIL, sc->NIL);
+     }
+     if (hint > HT_MAX_SIZE) {
+          sc->no_memory = 1;
+          return sc->sink;
+     }
+     x = get_cell(sc, sc->NIL, sc->NIL);
+     if (sc->no_memory) {
+          return sc->sink;
+     }
+     while (size*3 < hint*4) {
+          size *= 2;
+     }
+#if USE_HEAP_QUOTAS
+     if (!heap_quota(sc, 2*size*sizeof(pointer), 1)) {
+          sc->no_memory = 1;
+          return sc->sink;
+     }
+#endif
+     h = (struct hashtab*)sc->malloc(sizeof(struct hashtab));
+     if (h == 0) {
+          sc->no_memory = 1;
+          return sc->sink;
+     }
+     h->keys = ht_alloc_slots(sc, size);
+     if (h->keys == 0) {
+          sc->free(h);
+          return sc->sink;
+     }
+     h->kind = kind;
+     h->weak = HT_STRONG;
+     h->count = 0;
+     h->size = size;
+     h->used = 0;
+     h->vals = h->keys+size;
+     h->old_keys = h->old_vals = 0;
+     h->old_size = h->old_pos = 0;
+     typeflag(x) = (T_HASHTABLE | T_ATOM);
+     x->_object._hash = h;
+     return x;
+}
+
+static void free_hashtable(Lax *sc, struct hashtab *h) {
+     ht_free_slots(sc, h->keys, h->size);
+     ht_free_slots(sc, h->old_keys, h->old_size);
+     sc->free(h);
+}
+
+static void mark_slots(struct mark_stack *ms, pointer *keys, pointer *vals, size_t size, int weak) {
+     size_t i;
+     for (i = 0; i < size; i++) {
+          if (ht_live(keys[i])) {
+               if (!weak) {
+                    mark_push(ms, keys[i]);
+               }
+               mark_push(ms, vals[i]);
+          }
+     }
+}
+
+/* an ephemeron table's values wait for gc_weak() */
+static void mark_hashtable(struct mark_stack *ms, struct hashtab *h) {
+     if (h->weak == HT_EPHEMERON) {
+          return;
+     }
+     mark_slots(ms, h->keys, h->vals, h->size, h->weak);
+     if (h->old_keys != 0) {
+          mark_slots(ms, h->old_keys, h->old_vals, h->old_size, h->weak);
+     }
+}
+
+#if USE_PARALLEL_MARK
+static void par_push_hashtable(struct marker *w, struct hashtab *h) {
+     pointer *keys = h->keys, *vals = h->vals;
+     size_t size = h->size, i;
+     int pass;
+
+     if (h->weak == HT_EPHEMERON) {
+          return;
+     }
+     for (pass = 0; pass < 2; pass++) {
+          for (i = 0; i < size; i++) {
+               if (ht_live(keys[i])) {
+                    if (!h->weak) {
+                         par_push(w, keys[i]);
+                    }
+                    par_push(w, vals[i]);
+               }
+          }
+          if (h->old_keys == 0)
+               break;
+          keys = h->old_keys;
+          vals = h->old_vals;
+          size = h->old_size;
+     }
+}
+#endif
+
+#if USE_INCREMENTAL_GC
+static void shade_slots(Lax *sc, pointer *keys, pointer *vals, size_t size, int weak) {
+     size_t i;
+     for (i = 0; i < size; i++) {
+          if (ht_live(keys[i])) {
+               if (!weak) {
+                    gc_shade(sc, keys[i]);
+               }
+               gc_shade(sc, vals[i]);
+          }
+     }
+}
+
+static void shade_hashtable(Lax *sc, struct hashtab *h) {
+     if (h->weak == HT_EPHEMERON) {
+          return;
+     }
+     shade_slots(sc, h->keys, h->vals, h->size, h->weak);
+     if (h->old_keys != 0) {
+          shade_slots(sc, h->old_keys, h->old_vals, h->old_size, h->weak);
+     }
+}
+#endif
+
+static pointer ht_list(Lax *sc, struct hashtab *h, int with_values) {
+     pointer *keys = h->keys, *vals = h->vals;
+     size_t size = h->size, i;
+     pointer x = sc->NIL;
+     int pass;
+
+     for (pass = 0; pass < 2; pass++) {
+          for (i = 0; i < size; i++) {
+               if (ht_live(keys[i])) {
+                    x = cons(sc, with_values ? cons(sc, keys[i], vals[i]) : keys[i], x);
+               }
+          }
+          if (h->old_keys == 0)
+               break;
+          keys = h->old_keys;
+          vals = h->old_vals;
+          size = h->old_size;
+     }
+     return x;
+}
+
+/* Weak boxes, weak and ephemeron tables and guardians are listed in
+   sc->weak for gc_weak(); the list does not keep them alive. */
+static int weak_register(Lax *sc, pointer p) {
+     if (sc->nweak == sc->weak_cap) {
+          long cap = sc->weak_cap ? 2*sc->weak_cap : 64;
+          pointer *w = (pointer*)sc->malloc(cap*sizeof(pointer));
+          if (w == 0) {
+               sc->no_memory = 1;
+               return 0;
+          }
+          if (sc->weak != 0) {
+               memcpy(w, sc->weak, sc->nweak*sizeof(pointer));
+               sc->free(sc->weak);
+          }
+          sc->weak = w;
+          sc->weak_cap = cap;
+     }
+     sc->weak[sc->nweak++] = p;
+     return 1;
+}
+
+static pointer mk_weakbox(Lax *sc, pointer obj, pointer next) {
+     pointer x = get_cell(sc, obj, next);
+
+     typeflag(x) = (T_WEAKBOX | T_ATOM);
+     car(x) = obj;
+     cdr(x) = next;
+     return x;
+}
+
+static pointer mk_weak_hashtable(Lax *sc, int kind, int weak, size_t hint) {
+     pointer x = mk_hashtable(sc, kind, hint);
+
+     if (x != sc->sink) {
+          x->_object._hash->weak = weak;
+          weak_register(sc, x);
+     }
+     return x;
+}
+
+#define gc_kept(sc,p)  (is_mark(p) || (p) == (sc)->NIL || (p) == (sc)->EOF_OBJ)
+
+/* mark the values of an ephemeron table whose keys are marked */
+static int ephemeron_mark(Lax *sc, pointer *keys, pointer *vals, size_t size) {
+     size_t i;
+     int more = 0;
+
+     for (i = 0; i < size; i++) {
+          if (ht_live(keys[i]) && gc_kept(sc, keys[i]) && !gc_kept(sc, vals[i])) {
+               mark(vals[i]);
+               more = 1;
+          }
+     }
+     return more;
 }
 
-static pointer mk_closure(Lax *sc, pointer c, pointer e) {
-     pointer x = get_cell(sc, c, e);
+/* move the unmarked objects registered with g to its ready list; each
+   chain box becomes the pair that holds its object there */
+static int guardian_take(Lax *sc, pointer g) {
+     pointer *pp = &cdr(g), p;
+     int more = 0;
 
-     typeflag(x) = T_CLOSURE;
-     car(x) = c;
-     cdr(x) = e;
-     return (x);
+     while ((p = *pp) != sc->NIL) {
+          if (gc_kept(sc, car(p))) {
+               pp = &cdr(p);
+               continue;
+          }
+          *pp = cdr(p);
+          typeflag(p) = (typeflag(p) & ~(T_MASKTYPE|T_ATOM)) | T_PAIR;
+          cdr(p) = car(g);
+          car(g) = p;
+          mark(p);
+          more = 1;
+     }
+     return more;
 }
 
-static pointer mk_continuation(Lax *sc, pointer d) {
-     pointer x = get_cell(sc, sc->NIL, d);
+static void ht_prune(Lax *sc, struct hashtab *h, pointer *keys, pointer *vals, size_t size) {
+     size_t i;
 
-     typeflag(x) = T_CONTINUATION;
-     cont_dump(x) = d;
-     return (x);
+     for (i = 0; i < size; i++) {
+          if (ht_live(keys[i]) && !gc_kept(sc, keys[i])) {
+               keys[i] = HT_DELETED;
+               vals[i] = 0;
+               h->count--;
+          }
+     }
 }
 
-static pointer list_star(Lax *sc, pointer d) {
-  pointer p, q;
-  if(cdr(d)==sc->NIL) {
-    return car(d);
-  }
-  p=cons(sc,car(d),cdr(d));
-  q=p;
-  while(cdr(cdr(p))!=sc->NIL) {
-    d=cons(sc,car(p),cdr(p));
-    if(cdr(cdr(p))!=sc->NIL) {
-      p=cdr(d);
-    }
-  }
-  cdr(p)=car(cdr(p));
-  return q;
+/* Runs once marking is done.  Ephemeron values whose keys survived and
+   objects guardians take back are marked, over again until neither
+   finds more; then weak boxes and tables drop whatever is unmarked,
+   and the list drops the dead. */
+static void gc_weak(Lax *sc) {
+     long i, n;
+     int more;
+
+     if (sc->nweak == 0) {
+          return;
+     }
+     do {
+          more = 0;
+          for (i = 0; i < sc->nweak; i++) {
+               pointer w = sc->weak[i];
+               if (!is_mark(w)) {
+                    continue;
+               }
+               if (is_hashtable(w) && w->_object._hash->weak == HT_EPHEMERON) {
+                    struct hashtab *h = w->_object._hash;
+                    more |= ephemeron_mark(sc, h->keys, h->vals, h->size);
+                    if (h->old_keys != 0) {
+                         more |= ephemeron_mark(sc, h->old_keys, h->old_vals, h->old_size);
+                    }
+               } else if (is_guardian(w)) {
+                    more |= guardian_take(sc, w);
+               }
+          }
+     } while (more);
+     for (i = n = 0; i < sc->nweak; i++) {
+          pointer w = sc->weak[i];
+          if (!is_mark(w)) {
+               continue;
+          }
+          if (is_weakbox(w)) {
+               if (!gc_kept(sc, car(w))) {
+                    car(w) = sc->F;
+                    cdr(w) = sc->T;
+               }
+          } else if (is_hashtable(w) && w->_object._hash->weak != HT_STRONG) {
+               struct hashtab *h = w->_object._hash;
+               ht_prune(sc, h, h->keys, h->vals, h->size);
+               if (h->old_keys != 0) {
+                    ht_prune(sc, h, h->old_keys, h->old_vals, h->old_size);
+               }
+          } else if (!is_guardian(w)) {
+               continue;
+          }
+          sc->weak[n++] = w;
+     }
+     sc->nweak = n;
 }
 
-static pointer reverse(Lax *sc, pointer a) {
-     pointer p = sc->NIL;
+/* A record is laid out like a vector whose slot 0 holds its record
+   type; the record type keeps its name and field names the same way.
+   Record procedures are (type . kind+index) cells run by OP_RECAPPLY. */
+enum { RP_CTOR, RP_PRED, RP_GET, RP_SET };
 
-     for ( ; is_pair(a); a = cdr(a)) {
-          p = cons(sc, car(a), p);
+static pointer mk_recproc(Lax *sc, pointer rtd, int kind, int index) {
+     pointer x = get_cell(sc, rtd, mk_integer(sc, kind | (index << 2)));
+     typeflag(x) = T_RECPROC;
+     return x;
+}
+
+static int rectype_field(Lax *sc, pointer rtd, pointer name) {
+     size_t i;
+     if (is_string(name)) {
+          name = mk_symbol(sc, string_cstr(sc, name));
      }
-     return (p);
+     for (i = 1; i < veclen(rtd); i++) {
+          if (vector_elem(rtd, i) == name) {
+               return (int)i;
+          }
+     }
+     return -1;
 }
 
-static pointer reverse_in_place(Lax *sc, pointer term, pointer list) {
-     pointer p = list, result = term, q;
+static pointer mk_numvector(Lax *sc, int t, size_t len) {
+     pointer x;
+     size_t bytes = len*(t == T_U8VECTOR ? 1 : 8);
+     char *raw;
 
-     while (p != sc->NIL) {
-          q = cdr(p);
-          cdr(p) = result;
-          result = p;
-          p = q;
+     if (len > numvec_max_len(t)) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     if (sc->large_bytes > sc->large_limit) {
+          gc_large(sc, sc->NIL, sc->NIL);
+     }
+     x = get_cell(sc, sc->NIL, sc->NIL);
+     if (sc->no_memory) { return sc->sink; }
+#if USE_HEAP_QUOTAS
+     if (!heap_quota(sc, bytes, 1)) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+#endif
+     raw = (char*)sc->malloc(bytes+NUMVEC_ALIGN);
+     if (raw == 0) {
+          sc->no_memory=1;
+          return sc->sink;
+     }
+     typeflag(x) = (t | T_ATOM);
+     numvec_raw(x) = raw;
+     numvec_len(x) = len;
+     memset(numvec_data(x), 0, bytes);
+     sc->large_bytes += bytes;
+     return x;
+}
+
+static pointer numvec_ref(Lax *sc, pointer v, size_t i) {
+     switch (type(v)) {
+     case T_F64VECTOR:
+          return mk_real(sc, ((double*)numvec_data(v))[i]);
+     case T_S64VECTOR:
+          return mk_integer(sc, (long)((long long*)numvec_data(v))[i]);
+     default:
+          return mk_integer(sc, ((unsigned char*)numvec_data(v))[i]);
      }
-     return (result);
 }
 
-static pointer revappend(Lax *sc, pointer a, pointer b) {
-    pointer result = a;
-    pointer p = b;
+/* 0 if x does not fit the element type */
+static int numvec_set(pointer v, size_t i, pointer x) {
+     switch (type(v)) {
+     case T_F64VECTOR:
+          if (!is_number(x))
+               return 0;
+          ((double*)numvec_data(v))[i] = rvalue(x);
+          return 1;
+     case T_S64VECTOR:
+          if (!is_integer(x) || is_bignum(x))
+               return 0;
+          ((long long*)numvec_data(v))[i] = ivalue(x);
+          return 1;
+     default:
+          if (!is_integer(x) || is_bignum(x) || ivalue(x) < 0 || ivalue(x) > 255)
+               return 0;
+          ((unsigned char*)numvec_data(v))[i] = (unsigned char)ivalue(x);
+          return 1;
+     }
+}
 
-    while (is_pair(p)) {
-        result = cons(sc, car(p), result);
-        p = cdr(p);
-    }
+/* Element-wise kernels.  With GCC vector extensions the main loops work
+   on NUMVEC_ALIGN bytes at a time (SSE2 by default, AVX with -mavx) and
+   the scalar loop only handles the tail.  s64 arithmetic is done on
+   unsigned lanes, so it wraps instead of being undefined. */
+#if USE_SIMD
+typedef double nv_f64 __attribute__((vector_size(NUMVEC_ALIGN), __may_alias__));
+typedef unsigned long long nv_u64 __attribute__((vector_size(NUMVEC_ALIGN), __may_alias__));
+typedef unsigned char nv_u8 __attribute__((vector_size(NUMVEC_ALIGN), __may_alias__));
+#define NV_LANES(ET)     (NUMVEC_ALIGN/sizeof(ET))
+#define NV_BLOCKS(ET,i,n,stmt) \
+     for (; (i)+NV_LANES(ET) <= (n); (i) += NV_LANES(ET)) { stmt; }
+#else
+#define NV_BLOCKS(ET,i,n,stmt)
+#endif
 
-    if (p == sc->NIL) {
-        return result;
-    }
+#define NV_MAP(ET,VT,r,a,b,n,OP) do { \
+     ET *r_ = (ET*)(r); \
+     const ET *a_ = (const ET*)(a), *b_ = (const ET*)(b); \
+     size_t i_ = 0; \
+     NV_BLOCKS(ET, i_, n, *(VT*)(r_+i_) = *(const VT*)(a_+i_) OP *(const VT*)(b_+i_)) \
+     for (; i_ < (n); i_++) r_[i_] = a_[i_] OP b_[i_]; \
+} while (0)
+
+#define NV_SCALE(ET,VT,r,a,n,k) do { \
+     ET *r_ = (ET*)(r); \
+     const ET *a_ = (const ET*)(a); \
+     ET k_ = (k); \
+     size_t i_ = 0; \
+     NV_BLOCKS(ET, i_, n, *(VT*)(r_+i_) = *(const VT*)(a_+i_) * k_) \
+     for (; i_ < (n); i_++) r_[i_] = a_[i_] * k_; \
+} while (0)
+
+static double nv_dot_f64(const double *a, const double *b, size_t n) {
+     double s = 0;
+     size_t i = 0;
+#if USE_SIMD
+     nv_f64 acc = {0};
+     size_t j;
+     NV_BLOCKS(double, i, n, acc += *(const nv_f64*)(a+i) * *(const nv_f64*)(b+i))
+     for (j = 0; j < NV_LANES(double); j++) s += acc[j];
+#endif
+     for (; i < n; i++) s += a[i]*b[i];
+     return s;
+}
+
+static double nv_sum_f64(const double *a, size_t n) {
+     double s = 0;
+     size_t i = 0;
+#if USE_SIMD
+     nv_f64 acc = {0};
+     size_t j;
+     NV_BLOCKS(double, i, n, acc += *(const nv_f64*)(a+i))
+     for (j = 0; j < NV_LANES(double); j++) s += acc[j];
+#endif
+     for (; i < n; i++) s += a[i];
+     return s;
+}
+
+static unsigned long long nv_dot_u64(const unsigned long long *a, const unsigned long long *b, size_t n) {
+     unsigned long long s = 0;
+     size_t i = 0;
+#if USE_SIMD
+     nv_u64 acc = {0};
+     size_t j;
+     NV_BLOCKS(unsigned long long, i, n, acc += *(const nv_u64*)(a+i) * *(const nv_u64*)(b+i))
+     for (j = 0; j < NV_LANES(unsigned long long); j++) s += acc[j];
+#endif
+     for (; i < n; i++) s += a[i]*b[i];
+     return s;
+}
+
+static unsigned long long nv_sum_u64(const unsigned long long *a, size_t n) {
+     unsigned long long s = 0;
+     size_t i = 0;
+#if USE_SIMD
+     nv_u64 acc = {0};
+     size_t j;
+     NV_BLOCKS(unsigned long long, i, n, acc += *(const nv_u64*)(a+i))
+     for (j = 0; j < NV_LANES(unsigned long long); j++) s += acc[j];
+#endif
+     for (; i < n; i++) s += a[i];
+     return s;
+}
 
-    return sc->F;
+static long nv_dot_u8(const unsigned char *a, const unsigned char *b, size_t n) {
+     long s = 0;
+     size_t i;
+     for (i = 0; i < n; i++) s += (long)a[i]*b[i];
+     return s;
 }
 
-int eqv(pointer a, pointer b) {
-     if (is_string(a)) {
-          if (is_string(b))
-               return (strvalue(a) == strvalue(b));
-          else
-               return (0);
-     } else if (is_number(a)) {
-          if (is_number(b)) {
-               if (num_is_integer(a) == num_is_integer(b))
-                    return num_eq(nvalue(a),nvalue(b));
+static long nv_sum_u8(const unsigned char *a, size_t n) {
+     long s = 0;
+     size_t i;
+     for (i = 0; i < n; i++) s += a[i];
+     return s;
+}
+
+/* index of the smallest (or largest) element of a non-empty vector */
+static size_t nv_extreme(pointer v, int want_max) {
+     size_t i, k = 0, n = numvec_len(v);
+     switch (type(v)) {
+     case T_F64VECTOR: {
+          const double *a = (const double*)numvec_data(v);
+          for (i = 1; i < n; i++)
+               if (want_max ? a[i] > a[k] : a[i] < a[k]) k = i;
+          break;
+     }
+     case T_S64VECTOR: {
+          const long long *a = (const long long*)numvec_data(v);
+          for (i = 1; i < n; i++)
+               if (want_max ? a[i] > a[k] : a[i] < a[k]) k = i;
+          break;
+     }
+     default: {
+          const unsigned char *a = (const unsigned char*)numvec_data(v);
+          for (i = 1; i < n; i++)
+               if (want_max ? a[i] > a[k] : a[i] < a[k]) k = i;
+          break;
+     }
+     }
+     return k;
+}
+
+static void print_numvector(Lax *sc, pointer v) {
+     size_t i, n = numvec_len(v);
+     char *p = sc->strbuff;
+     int f;
+
+     putstr(sc, is_f64vector(v) ? "#f64[" : is_s64vector(v) ? "#s64[" : "#u8[");
+     for (i = 0; i < n; i++) {
+          switch (type(v)) {
+          case T_F64VECTOR:
+               snprintf(p, STRBUFFSIZE, "%.10g", ((double*)numvec_data(v))[i]);
+               f = strcspn(p, ".e");
+               if (p[f] == 0) {
+                    p[f] = '.';
+                    p[f+1] = '0';
+                    p[f+2] = 0;
+               }
+               break;
+          case T_S64VECTOR:
+               snprintf(p, STRBUFFSIZE, "%lld", ((long long*)numvec_data(v))[i]);
+               break;
+          default:
+               snprintf(p, STRBUFFSIZE, "%d", ((unsigned char*)numvec_data(v))[i]);
+               break;
+          }
+          if (i > 0)
+               putstr(sc, " ");
+          putstr(sc, p);
+     }
+     putstr(sc, "]");
+}
+
+/* optional start and end arguments; 0 if the range does not fit len */
+static int bv_range(Lax *sc, pointer args, size_t len, size_t *start, size_t *end) {
+     *start = 0;
+     *end = len;
+     if (args != sc->NIL) {
+          *start = ivalue(car(args));
+          if (cdr(args) != sc->NIL) {
+               *end = ivalue(cadr(args));
           }
-          return (0);
-     } else if (is_character(a)) {
-          if (is_character(b))
-               return charvalue(a)==charvalue(b);
-          else
-               return (0);
-     } else if (is_port(a)) {
-          if (is_port(b))
-               return a==b;
-          else
-               return (0);
-     } else if (is_proc(a)) {
-          if (is_proc(b))
-               return procnum(a)==procnum(b);
-          else
-               return (0);
-     } else {
-          return (a == b);
      }
+     return *start <= *end && *end <= len;
 }
 
 #define is_true(p)       ((p) != sc->F)
@@ -2065,12 +5643,13 @@ static INLINE void new_slot_spec_in_env(Lax *sc, pointer env,
   pointer slot = immutable_cons(sc, variable, value);
 
   if (is_vector(car(env))) {
-    int location = hash_fn(symname(variable), ivalue_unchecked(car(env)));
+    int location = hash_fn(symname(variable), veclen(car(env)));
 
-    set_vector_elem(car(env), location,
+    set_vector_elem(sc, car(env), location,
                     immutable_cons(sc, slot, vector_elem(car(env), location)));
   } else {
     car(env) = immutable_cons(sc, slot, car(env));
+    gc_barrier(sc, env, car(env));
   }
 }
 
@@ -2081,7 +5660,7 @@ static pointer find_slot_in_env(Lax *sc, pointer env, pointer hdl, int all)
 
   for (x = env; x != sc->NIL; x = cdr(x)) {
     if (is_vector(car(x))) {
-      location = hash_fn(symname(hdl), ivalue_unchecked(car(x)));
+      location = hash_fn(symname(hdl), veclen(car(x)));
       y = vector_elem(car(x), location);
     } else {
       y = car(x);
@@ -2116,6 +5695,7 @@ static INLINE void new_slot_spec_in_env(Lax *sc, pointer env,
                                         pointer variable, pointer value)
 {
   car(env) = immutable_cons(sc, immutable_cons(sc, variable, value), car(env));
+  gc_barrier(sc, env, car(env));
 }
 
 static pointer find_slot_in_env(Lax *sc, pointer env, pointer hdl, int all)
@@ -2149,6 +5729,7 @@ static INLINE void new_slot_in_env(Lax *sc, pointer variable, pointer value)
 
 static INLINE void set_slot_in_env(Lax *sc, pointer slot, pointer value)
 {
+  gc_barrier(sc, slot, value);
   cdr(slot) = value;
 }
 
@@ -2190,18 +5771,21 @@ static pointer _Error_1(Lax *sc, const char *s, pointer a) {
 #endif
 
 #if USE_ERROR_HOOK
-     x=find_slot_in_env(sc,sc->envir,hdl,1);
+     x=sc->in_error_hook ? sc->NIL : find_slot_in_env(sc,sc->envir,hdl,1);
     if (x != sc->NIL) {
+         /* an error raised by the hook itself is reported plainly */
+         sc->in_error_hook = 1;
+         s_save(sc,OP_ERR2, sc->NIL, sc->NIL);
          if(a!=0) {
                sc->code = cons(sc, cons(sc, sc->QUOTE, cons(sc,(a), sc->NIL)), sc->NIL);
          } else {
                sc->code = sc->NIL;
          }
-         sc->code = cons(sc, mk_string(sc, str), sc->code);
+         sc->code = cons(sc, mk_string(sc, s), sc->code);
          setimmutable(car(sc->code));
          sc->code = cons(sc, slot_value_in_env(x), sc->code);
          sc->op = (int)OP_EVAL;
-         return sc->NIL;
+         return sc->T;
     }
 #endif
 
@@ -2234,6 +5818,21 @@ static pointer _Error_1(Lax *sc, const char *s, pointer a) {
 #define Error_1(sc,s, a) return _Error_1(sc,s,a)
 #define Error_0(sc,s)    return _Error_1(sc,s,0)
 
+#define values_clear(sc) ((sc)->nvalues = 0, (sc)->values_more = (sc)->NIL)
+/* only receive, let-values and call-with-values take several values */
+#define values_taken(op) ((op) == OP_RECEIVE1 || (op) == OP_LETV2 \
+                          || (op) == OP_CALLVAL1)
+
+/* a value for a continuation that takes one: the first of several */
+static pointer values_single(Lax *sc, pointer a) {
+  if (a != sc->VALUES) {
+    return a;
+  }
+  a = sc->nvalues > 0 ? sc->values[0] : sc->NIL;
+  values_clear(sc);
+  return a;
+}
+
 #ifndef USE_Lax_STACK
 
 struct dump_stack_frame {
@@ -2268,12 +5867,13 @@ static pointer _s_return(Lax *sc, pointer a)
   int nframes = (int)sc->dump;
   struct dump_stack_frame *frame;
 
-  sc->value = (a);
   if (nframes <= 0) {
+    sc->value = values_single(sc, a);
     return sc->NIL;
   }
   nframes--;
   frame = (struct dump_stack_frame *)sc->dump_base + nframes;
+  sc->value = values_taken(frame->op) ? a : values_single(sc, a);
   sc->op = frame->op;
   sc->args = frame->args;
   sc->envir = frame->envir;
@@ -2285,6 +5885,8 @@ static pointer _s_return(Lax *sc, pointer a)
 static INLINE void dump_stack_reset(Lax *sc)
 {
   sc->dump = (pointer)0;
+  values_clear(sc);
+  error_hook_done(sc);
 }
 
 static INLINE void dump_stack_initialize(Lax *sc)
@@ -2302,16 +5904,16 @@ static void dump_stack_free(Lax *sc)
   sc->dump_size = 0;
 }
 
-static INLINE void dump_stack_mark(Lax *sc)
+static INLINE void dump_stack_visit(Lax *sc, void (*visit)(void *, pointer), void *ctx)
 {
   int nframes = (int)sc->dump;
   int i;
   for(i=0; i<nframes; i++) {
     struct dump_stack_frame *frame;
     frame = (struct dump_stack_frame *)sc->dump_base + i;
-    mark(frame->args);
-    mark(frame->envir);
-    mark(frame->code);
+    visit(ctx, frame->args);
+    visit(ctx, frame->envir);
+    visit(ctx, frame->code);
   }
 }
 
@@ -2320,6 +5922,8 @@ static INLINE void dump_stack_mark(Lax *sc)
 static INLINE void dump_stack_reset(Lax *sc)
 {
   sc->dump = sc->NIL;
+  values_clear(sc);
+  error_hook_done(sc);
 }
 
 static INLINE void dump_stack_initialize(Lax *sc)
@@ -2333,9 +5937,12 @@ static void dump_stack_free(Lax *sc)
 }
 
 static pointer _s_return(Lax *sc, pointer a) {
-    sc->value = (a);
-    if(sc->dump==sc->NIL) return sc->NIL;
+    if(sc->dump==sc->NIL) {
+      sc->value = values_single(sc, a);
+      return sc->NIL;
+    }
     sc->op = ivalue(car(sc->dump));
+    sc->value = values_taken(sc->op) ? a : values_single(sc, a);
     sc->args = cadr(sc->dump);
     sc->envir = caddr(sc->dump);
     sc->code = cadddr(sc->dump);
@@ -2349,10 +5956,6 @@ static void s_save(Lax *sc, enum Lax_opcodes op, pointer args, pointer code) {
     sc->dump = cons(sc, mk_integer(sc, (long)(op)), sc->dump);
 }
 
-static INLINE void dump_stack_mark(Lax *sc)
-{
-  mark(sc->dump);
-}
 #endif
 
 #define s_retbool(tf)    s_return(sc,(tf) ? sc->T : sc->F)
@@ -2364,9 +5967,9 @@ static pointer opexe_0(Lax *sc, enum Lax_opcodes op) {
      case OP_LOAD:
           if(file_interactive(sc)) {
                fprintf(sc->outport->_object._port->rep.stdio.file,
-               "Loading %s\n", strvalue(car(sc->args)));
+               "Loading %s\n", string_cstr(sc,car(sc->args)));
           }
-          if (!file_push(sc,strvalue(car(sc->args)))) {
+          if (!file_push(sc,string_cstr(sc,car(sc->args)))) {
                Error_1(sc,"unable to open", car(sc->args));
           }
       else
@@ -2525,9 +6128,16 @@ case OP_VALUEPRINT:
 #endif
           if (is_proc(sc->code)) {
                s_goto(sc,procnum(sc->code));
+          } else if (is_recproc(sc->code)) {
+               s_goto(sc,OP_RECAPPLY);
           } else if (is_foreign(sc->code))
             {
-              push_recent_alloc(sc,sc->args,sc->NIL);
+              push_recent_alloc(sc,sc->args);
+               for (x = sc->args; is_pair(x); x = cdr(x)) {
+                    if (is_string(car(x))) {
+                         string_cstr(sc, car(x));
+                    }
+               }
                x=sc->code->_object._ff(sc,sc->args);
                s_return(sc,x);
           } else if (is_closure(sc->code) || is_macro(sc->code)
@@ -2552,6 +6162,11 @@ case OP_VALUEPRINT:
                s_goto(sc,OP_BEGIN);
           } else if (is_continuation(sc->code)) {
                sc->dump = cont_dump(sc->code);
+               error_hook_done(sc);
+               if (sc->args != sc->NIL && cdr(sc->args) != sc->NIL) {
+                    /* (k a b ...) is (k (values a b ...)) */
+                    s_return(sc,values_set(sc, sc->args));
+               }
                s_return(sc,sc->args != sc->NIL ? car(sc->args) : sc->NIL);
           } else {
                Error_0(sc,"illegal function");
@@ -2780,6 +6395,80 @@ case OP_VALUEPRINT:
     }
 }
 
+/* make the elements of list a the pending values; past MAX_VALUES
+   they are kept in a copy of the rest of the list */
+static pointer values_set(Lax *sc, pointer a) {
+     values_clear(sc);
+     for ( ; a != sc->NIL; a = cdr(a)) {
+          if (sc->nvalues == MAX_VALUES) {
+               sc->values_more = reverse_in_place(sc, sc->NIL, reverse(sc, a));
+               sc->nvalues += list_length(sc, a);
+               break;
+          }
+          sc->values[sc->nvalues++] = car(a);
+     }
+     return sc->VALUES;
+}
+
+/* sc->value as pending values: a lone value is moved into values[0] */
+static void values_fetch(Lax *sc) {
+     if (sc->value != sc->VALUES) {
+          values_clear(sc);
+          sc->values[0] = sc->value;
+          sc->nvalues = 1;
+     }
+}
+
+/* bind formals, a list that may end in a rest symbol, to the pending
+   values in frame env; 0 when the counts do not match */
+static int bind_values(Lax *sc, pointer env, pointer formals) {
+     pointer more, rest;
+     int i, n;
+
+     values_fetch(sc);
+     n = sc->nvalues;
+     more = sc->values_more;
+     for (i = 0; is_pair(formals); formals = cdr(formals), i++) {
+          if (i == n || !is_symbol(car(formals))) {
+               values_clear(sc);
+               return 0;
+          }
+          if (i < MAX_VALUES) {
+               new_slot_spec_in_env(sc, env, car(formals), sc->values[i]);
+          } else {
+               new_slot_spec_in_env(sc, env, car(formals), car(more));
+               more = cdr(more);
+          }
+     }
+     if (is_symbol(formals)) {
+          /* the spilled list is ours to hand out */
+          rest = more;
+          for (n = n < MAX_VALUES ? n : MAX_VALUES; n-- > i; ) {
+               rest = cons(sc, sc->values[n], rest);
+          }
+          new_slot_spec_in_env(sc, env, formals, rest);
+     } else if (formals != sc->NIL || i != n) {
+          values_clear(sc);
+          return 0;
+     }
+     values_clear(sc);
+     return 1;
+}
+
+/* pending values as an argument list */
+static pointer values_list(Lax *sc) {
+     pointer x;
+     int i;
+
+     values_fetch(sc);
+     x = sc->values_more;
+     for (i = sc->nvalues < MAX_VALUES ? sc->nvalues : MAX_VALUES; i-- > 0; ) {
+          x = cons(sc, sc->values[i], x);
+     }
+     values_clear(sc);
+     return x;
+}
+
 static pointer opexe_1(Lax *sc, enum Lax_opcodes op) {
      pointer x, y;
      
@@ -2817,6 +6506,54 @@ static pointer opexe_1(Lax *sc, enum Lax_opcodes op) {
           sc->args = sc->NIL;
           s_goto(sc,OP_BEGIN);
 
+     case OP_RECEIVE0:     /* (receive formals expr body...) */
+          if (!is_pair(sc->code) || !is_pair(cdr(sc->code))) {
+               Error_1(sc,"Bad syntax of receive :",sc->code);
+          }
+          s_save(sc,OP_RECEIVE1, sc->NIL, sc->code);
+          sc->code = cadr(sc->code);
+          s_goto(sc,OP_EVAL);
+
+     case OP_RECEIVE1:
+          new_frame_in_env(sc, sc->envir);
+          if (!bind_values(sc, sc->envir, car(sc->code))) {
+               Error_1(sc,"receive: wrong number of values for",car(sc->code));
+          }
+          sc->code = cddr(sc->code);
+          s_goto(sc,OP_BEGIN);
+
+     case OP_LETV0:        /* inits see the outer environment; args is (frame . body) */
+          if (!is_pair(sc->code)) {
+               Error_1(sc,"Bad syntax of let-values :",sc->code);
+          }
+          new_frame_in_env(sc, sc->envir);
+          sc->args = cons(sc, sc->envir, cdr(sc->code));
+          sc->envir = cdr(sc->envir);
+          sc->code = car(sc->code);
+          s_goto(sc,OP_LETV1);
+
+     case OP_LETV1:
+          if (is_pair(sc->code)) {
+               if (!is_pair(car(sc->code)) || !is_pair(cdar(sc->code))) {
+                    Error_1(sc,"Bad syntax of binding spec in let-values :",
+                            car(sc->code));
+               }
+               s_save(sc,OP_LETV2, sc->args, sc->code);
+               sc->code = cadar(sc->code);
+               s_goto(sc,OP_EVAL);
+          }
+          sc->envir = car(sc->args);
+          sc->code = cdr(sc->args);
+          sc->args = sc->NIL;
+          s_goto(sc,OP_BEGIN);
+
+     case OP_LETV2:
+          if (!bind_values(sc, car(sc->args), caar(sc->code))) {
+               Error_1(sc,"let-values: wrong number of values for",caar(sc->code));
+          }
+          sc->code = cdr(sc->code);
+          s_goto(sc,OP_LETV1);
+
      case OP_COND0:
           if (!is_pair(sc->code)) {
                Error_0(sc,"syntax error in cond");
@@ -2918,7 +6655,10 @@ static pointer opexe_1(Lax *sc, enum Lax_opcodes op) {
           s_goto(sc,OP_EVAL);
 
      case OP_MACRO1:
-          typeflag(sc->value) = T_MACRO;
+          if (is_immediate(sc->value)) {
+               Error_1(sc,"macro: not a procedure:",sc->value);
+          }
+          typeflag(sc->value) = T_MACRO | (typeflag(sc->value)&MARK);
           x = find_slot_in_env(sc, sc->envir, sc->code, 0);
           if (x != sc->NIL) {
                set_slot_in_env(sc, x, sc->value);
@@ -2983,6 +6723,22 @@ static pointer opexe_1(Lax *sc, enum Lax_opcodes op) {
           sc->args = cons(sc, mk_continuation(sc, sc->dump), sc->NIL);
           s_goto(sc,OP_APPLY);
 
+     case OP_VALUES:
+          if (sc->args != sc->NIL && cdr(sc->args) == sc->NIL) {
+               s_return(sc,car(sc->args));
+          }
+          s_return(sc,values_set(sc, sc->args));
+
+     case OP_CALLVAL:      /* call-with-values */
+          s_save(sc,OP_CALLVAL1, sc->NIL, cadr(sc->args));
+          sc->code = car(sc->args);
+          sc->args = sc->NIL;
+          s_goto(sc,OP_APPLY);
+
+     case OP_CALLVAL1:
+          sc->args = values_list(sc);
+          s_goto(sc,OP_APPLY);
+
      default:
           snprintf(sc->strbuff,STRBUFFSIZE,"%d: illegal operator", sc->op);
           Error_0(sc,sc->strbuff);
@@ -3004,6 +6760,9 @@ static pointer opexe_2(Lax *sc, enum Lax_opcodes op) {
           if(num_is_integer(x)) {
                s_return(sc,x);
           } else if(modf(rvalue_unchecked(x),&dd)==0.0) {
+               if(dd < (double)LONG_MIN || dd >= -(double)LONG_MIN) {
+                    s_return(sc,big_from_double(sc,dd));
+               }
                s_return(sc,mk_integer(sc,ivalue(x)));
           } else {
                Error_1(sc,"inexact->exact: not integral:",x);
@@ -3075,6 +6834,9 @@ case OP_TARRY: {
           int real_result=1;
           pointer y=cadr(sc->args);
           x=car(sc->args);
+          if (num_is_integer(x) && num_is_integer(y) && !is_bignum(y) && ivalue(y) >= 0) {
+             s_return(sc, int_expt(sc, x, ivalue(y)));
+          }
           if (num_is_integer(x) && num_is_integer(y))
              real_result=0;
           if (rvalue(x) == 0 && rvalue(y) < 0) {
@@ -3122,31 +6884,9 @@ case OP_TARRY: {
 #endif
 
      case OP_ADD:
-       v=num_zero;
-       for (x = sc->args; x != sc->NIL; x = cdr(x)) {
-         v=num_add(v,nvalue(car(x)));
-       }
-       s_return(sc,mk_number(sc, v));
-
      case OP_MUL:
-       v=num_one;
-       for (x = sc->args; x != sc->NIL; x = cdr(x)) {
-         v=num_mul(v,nvalue(car(x)));
-       }
-       s_return(sc,mk_number(sc, v));
-
      case OP_SUB:
-       if(cdr(sc->args)==sc->NIL) {
-         x=sc->args;
-         v=num_zero;
-       } else {
-         x = cdr(sc->args);
-         v = nvalue(car(sc->args));
-       }
-       for (; x != sc->NIL; x = cdr(x)) {
-         v=num_sub(v,nvalue(car(x)));
-       }
-       s_return(sc,mk_number(sc, v));
+       s_return(sc,arith_fold(sc, op, sc->args));
 
      case OP_DIV:
        if(cdr(sc->args)==sc->NIL) {
@@ -3156,6 +6896,14 @@ case OP_TARRY: {
          x = cdr(sc->args);
          v = nvalue(car(sc->args));
        }
+       if (exact_divide(sc, car(sc->args), cdr(sc->args))
+           && !is_zero_double(rvalue(cadr(sc->args)))) {
+         /* a quotient that comes out even stays exact */
+         pointer r = int_divide(sc, OP_REM, car(sc->args), cadr(sc->args));
+         if (sc->no_memory || (!is_bignum(r) && ivalue(r) == 0)) {
+           s_return(sc,int_divide(sc, OP_INTDIV, car(sc->args), cadr(sc->args)));
+         }
+       }
        for (; x != sc->NIL; x = cdr(x)) {
          if (!is_zero_double(rvalue(car(x))))
            v=num_div(v,nvalue(car(x)));
@@ -3173,6 +6921,12 @@ case OP_TARRY: {
                x = cdr(sc->args);
                v = nvalue(car(sc->args));
           }
+          if (exact_divide(sc, car(sc->args), cdr(sc->args))) {
+               if (ivalue(cadr(sc->args)) == 0) {
+                    Error_0(sc,"quotient: division by zero");
+               }
+               s_return(sc,int_divide(sc, op, car(sc->args), cadr(sc->args)));
+          }
           for (; x != sc->NIL; x = cdr(x)) {
                if (ivalue(car(x)) != 0)
                     v=num_intdiv(v,nvalue(car(x)));
@@ -3184,20 +6938,22 @@ case OP_TARRY: {
 
      case OP_REM:
           v = nvalue(car(sc->args));
-          if (ivalue(cadr(sc->args)) != 0)
-               v=num_rem(v,nvalue(cadr(sc->args)));
-          else {
+          if (ivalue(cadr(sc->args)) == 0) {
                Error_0(sc,"remainder: division by zero");
+          } else if (exact_divide(sc, car(sc->args), cdr(sc->args))) {
+               s_return(sc,int_divide(sc, op, car(sc->args), cadr(sc->args)));
           }
+          v=num_rem(v,nvalue(cadr(sc->args)));
           s_return(sc,mk_number(sc, v));
 
      case OP_MOD:
           v = nvalue(car(sc->args));
-          if (ivalue(cadr(sc->args)) != 0)
-               v=num_mod(v,nvalue(cadr(sc->args)));
-          else {
+          if (ivalue(cadr(sc->args)) == 0) {
                Error_0(sc,"modulo: division by zero");
+          } else if (exact_divide(sc, car(sc->args), cdr(sc->args))) {
+               s_return(sc,int_divide(sc, op, car(sc->args), cadr(sc->args)));
           }
+          v=num_mod(v,nvalue(cadr(sc->args)));
           s_return(sc,mk_number(sc, v));
 
      case OP_HEAD:
@@ -3207,12 +6963,12 @@ case OP_TARRY: {
           s_return(sc,cdar(sc->args));
 
      case OP_CONS:
-          cdr(sc->args) = cadr(sc->args);
+          set_cdr(sc, sc->args, cadr(sc->args));
           s_return(sc,sc->args);
 
      case OP_SETHEAD:
        if(!is_immutable(car(sc->args))) {
-         caar(sc->args) = cadr(sc->args);
+         set_car(sc, car(sc->args), cadr(sc->args));
          s_return(sc,car(sc->args));
        } else {
          Error_0(sc,"set-head!: unable to alter immutable pair");
@@ -3220,7 +6976,7 @@ case OP_TARRY: {
 
      case OP_SETTAIL:
        if(!is_immutable(car(sc->args))) {
-         cdar(sc->args) = cadr(sc->args);
+         set_cdr(sc, car(sc->args), cadr(sc->args));
          s_return(sc,car(sc->args));
        } else {
          Error_0(sc,"set-cdr!: unable to alter immutable pair");
@@ -3253,13 +7009,13 @@ case OP_TARRY: {
      }
 
      case OP_STR2SIGN:
-          s_return(sc,mk_symbol(sc,strvalue(car(sc->args))));
+          s_return(sc,mk_symbol(sc,string_cstr(sc,car(sc->args))));
 
      case OP_STR2ATOM: {
-          char *s=strvalue(car(sc->args));
+          char *s=string_cstr(sc,car(sc->args));
           long pf = 0;
           if(cdr(sc->args)!=sc->NIL) {
-            pf = ivalue_unchecked(cadr(sc->args));
+            pf = ivalue(cadr(sc->args));
             if(pf == 16 || pf == 10 || pf == 8 || pf == 2) {
             }
             else {
@@ -3278,6 +7034,9 @@ case OP_TARRY: {
               char *ep;
               long iv = strtol(s,&ep,(int )pf);
               if (*ep == 0) {
+                if (iv == LONG_MAX || iv == LONG_MIN) {
+                  s_return(sc, big_from_string(sc, s, (int )pf));
+                }
                 s_return(sc, mk_integer(sc, iv));
               }
               else {
@@ -3296,7 +7055,7 @@ case OP_TARRY: {
           long pf = 0;
           x=car(sc->args);
           if(cdr(sc->args)!=sc->NIL) {
-            pf = ivalue_unchecked(cadr(sc->args));
+            pf = ivalue(cadr(sc->args));
             if(is_number(x) && (pf == 16 || pf == 10 || pf == 8 || pf == 2)) {
             }
             else {
@@ -3317,9 +7076,12 @@ case OP_TARRY: {
 
      case OP_MKSTRING: {
           int fill=' ';
-          int len;
+          long len;
 
           len=ivalue(car(sc->args));
+          if(len > INT_MAX) {
+               Error_1(sc,"make-string: length too large:",car(sc->args));
+          }
 
           if(cdr(sc->args)!=sc->NIL) {
                fill=charvalue(cadr(sc->args));
@@ -3332,7 +7094,7 @@ case OP_TARRY: {
 
      case OP_STRREF: {
           char *str;
-          int index;
+          long index;
 
           str=strvalue(car(sc->args));
 
@@ -3347,18 +7109,17 @@ case OP_TARRY: {
 
      case OP_STRSET: {
           char *str;
-          int index;
+          long index;
           int c;
 
           if(is_immutable(car(sc->args))) {
                Error_1(sc,"string-set!: unable to alter immutable string:",car(sc->args));
           }
-          str=strvalue(car(sc->args));
-
           index=ivalue(cadr(sc->args));
           if(index>=strlength(car(sc->args))) {
                Error_1(sc,"string-set!: out of bounds:",cadr(sc->args));
           }
+          str=string_writable(sc,car(sc->args));
 
           c=charvalue(caddr(sc->args));
 
@@ -3383,13 +7144,10 @@ case OP_TARRY: {
      }
 
      case OP_SUBSTR: {
-          char *str;
-          int index0;
-          int index1;
+          long index0;
+          long index1;
           int len;
 
-          str=strvalue(car(sc->args));
-
           index0=ivalue(cadr(sc->args));
 
           if(index0>strlength(car(sc->args))) {
@@ -3406,11 +7164,7 @@ case OP_TARRY: {
           }
 
           len=index1-index0;
-          x=mk_empty_string(sc,len,' ');
-          memcpy(strvalue(x),str+index0,len);
-          strvalue(x)[len]=0;
-
-          s_return(sc,x);
+          s_return(sc,mk_substring(sc,car(sc->args),index0,len));
      }
 
      case OP_VECTOR: {
@@ -3423,38 +7177,41 @@ case OP_TARRY: {
           vec=mk_vector(sc,len);
           if(sc->no_memory) { s_return(sc, sc->sink); }
           for (x = sc->args, i = 0; is_pair(x); x = cdr(x), i++) {
-               set_vector_elem(vec,i,car(x));
+               set_vector_elem(sc,vec,i,car(x));
           }
           s_return(sc,vec);
      }
 
      case OP_MKVECTOR: {
           pointer fill=sc->NIL;
-          int len;
+          size_t len;
           pointer vec;
 
           len=ivalue(car(sc->args));
+          if(len > VECTOR_MAX_LEN) {
+               Error_1(sc,"make-vector: length too large:",car(sc->args));
+          }
 
           if(cdr(sc->args)!=sc->NIL) {
                fill=cadr(sc->args);
           }
-          vec=mk_vector(sc,len);
+          vec=get_vector_object(sc,len,sc->NIL);
           if(sc->no_memory) { s_return(sc, sc->sink); }
           if(fill!=sc->NIL) {
-               fill_vector(vec,fill);
+               fill_vector(sc,vec,fill);
           }
           s_return(sc,vec);
      }
 
      case OP_VECLEN:
-          s_return(sc,mk_integer(sc,ivalue(car(sc->args))));
+          s_return(sc,mk_integer(sc,vector_length(car(sc->args))));
 
      case OP_VECREF: {
-          int index;
+          long index;
 
           index=ivalue(cadr(sc->args));
 
-          if(index>=ivalue(car(sc->args))) {
+          if(index>=vector_length(car(sc->args))) {
                Error_1(sc,"vector-ref: out of bounds:",cadr(sc->args));
           }
 
@@ -3462,18 +7219,18 @@ case OP_TARRY: {
      }
 
      case OP_VECSET: {
-          int index;
+          long index;
 
           if(is_immutable(car(sc->args))) {
                Error_1(sc,"vector-set!: unable to alter immutable vector:",car(sc->args));
           }
 
           index=ivalue(cadr(sc->args));
-          if(index>=ivalue(car(sc->args))) {
+          if(index>=vector_length(car(sc->args))) {
                Error_1(sc,"vector-set!: out of bounds:",cadr(sc->args));
           }
 
-          set_vector_elem(car(sc->args),index,caddr(sc->args));
+          set_vector_elem(sc,car(sc->args),index,caddr(sc->args));
           s_return(sc,car(sc->args));
      }
 
@@ -3543,13 +7300,16 @@ static pointer opexe_3(Lax *sc, enum Lax_opcodes op) {
           }
           x=sc->args;
           v=nvalue(car(x));
-          x=cdr(x);
 
-          for (; x != sc->NIL; x = cdr(x)) {
-               if(!comp_func(v,nvalue(car(x)))) {
+          for (; cdr(x) != sc->NIL; x = cdr(x)) {
+               if(is_bignum(car(x)) || is_bignum(cadr(x))) {
+                    if(!big_compare(op, car(x), cadr(x))) {
+                         s_retbool(0);
+                    }
+               } else if(!comp_func(v,nvalue(cadr(x)))) {
                     s_retbool(0);
                }
-           v=nvalue(car(x));
+           v=nvalue(cadr(x));
           }
           s_retbool(1);
      case OP_SIGNP:
@@ -3584,7 +7344,8 @@ static pointer opexe_3(Lax *sc, enum Lax_opcodes op) {
           s_retbool(is_outport(car(sc->args)));
      case OP_PROCP:
           s_retbool(is_proc(car(sc->args)) || is_closure(car(sc->args))
-                 || is_continuation(car(sc->args)) || is_foreign(car(sc->args)));
+                 || is_continuation(car(sc->args)) || is_foreign(car(sc->args))
+                 || is_recproc(car(sc->args)));
      case OP_PAIRP:
           s_retbool(is_pair(car(sc->args)));
      case OP_LISTP:
@@ -3618,10 +7379,27 @@ static pointer opexe_4(Lax *sc, enum Lax_opcodes op) {
           } else {
                s_return(sc,sc->code);
           }
-
-     case OP_SAVE_FORCED:
-          memcpy(sc->code,sc->value,sizeof(struct cell));
+
+     case OP_SAVE_FORCED: {
+          int old = is_mark(sc->code) != 0;
+          if (is_immediate(sc->value)) {
+               typeflag(sc->code) = (type(sc->value) | T_ATOM);
+               ivalue_unchecked(sc->code) = imm_ivalue(sc->value);
+               set_num_integer(sc->code);
+          } else {
+               memcpy(sc->code,sc->value,sizeof(struct cell));
+               if (is_string(sc->value) && !is_inline_string(sc->value)) {
+                    strbuf_refs(strbuf(sc->value))++;
+               }
+#if USE_COMPACT_CELLS
+               typeflag(sc->code) = typeflag(sc->value);
+#endif
+          }
+          if (old) {
+               gc_keep(sc, sc->code);     /* see gc_barrier */
+          }
           s_return(sc,sc->value);
+     }
 
 case OP_IMAGE:
     if(is_pair(cdr(sc->args))) {
@@ -3678,11 +7456,16 @@ case OP_IMAGE:
                sc->args=cons(sc,mk_string(sc," -- "),sc->args);
                setimmutable(car(sc->args));
           }
-          Error_1(sc, strvalue(car(sc->args)), 0); 
+          Error_1(sc, string_cstr(sc,car(sc->args)),
+                  cdr(sc->args)!=sc->NIL ? cadr(sc->args) : 0);
 
      case OP_ERR1: 
          s_return(sc, sc->NIL);
 
+     case OP_ERR2:      /* the hook returned */
+          error_hook_done(sc);
+          s_return(sc, sc->value);
+
      case OP_REVERSE:
           s_return(sc,reverse(sc, car(sc->args)));
 
@@ -3715,10 +7498,10 @@ case OP_IMAGE:
                }
           }
           if (x != sc->NIL)
-               cdar(x) = caddr(sc->args);
+               set_cdr(sc, car(x), caddr(sc->args));
           else
-               symprop(car(sc->args)) = cons(sc, cons(sc, y, caddr(sc->args)),
-                                symprop(car(sc->args)));
+               set_cdr(sc, car(sc->args), cons(sc, cons(sc, y, caddr(sc->args)),
+                                symprop(car(sc->args))));
           s_return(sc,sc->T);
 
      case OP_GET:
@@ -3738,7 +7521,16 @@ case OP_IMAGE:
 #endif 
 
      case OP_GC:
+#if USE_INCREMENTAL_GC
+          /* the cycle under way keeps all it shaded, garbage made since
+             included, so drop its marks and collect from scratch */
+          gc_finish(sc);
+          clear_marks(sc);
+#endif
           gc(sc, sc->NIL, sc->NIL);
+#if USE_LAZY_SWEEP
+          gc_finish(sc);
+#endif
           s_return(sc,sc->T);
 
      case OP_GCVERB:
@@ -3752,6 +7544,9 @@ case OP_IMAGE:
           if (!is_pair(sc->args) || !is_number(car(sc->args))) {
                Error_0(sc,"Error: argument must be a number");
           }
+          if (is_bignum(car(sc->args))) {
+               Error_1(sc,"new-segment: count out of range:",car(sc->args));
+          }
           alloc_cellseg(sc, (int) ivalue(car(sc->args)));
           s_return(sc,sc->T);
 
@@ -3774,7 +7569,7 @@ case OP_IMAGE:
                case OP_OPEN_OUTFILE:    prop=port_output; break;
                case OP_OPEN_INOUTFILE: prop=port_input|port_output; break;
           }
-          p=port_from_filename(sc,strvalue(car(sc->args)),prop);
+          p=port_from_filename(sc,string_cstr(sc,car(sc->args)),prop);
           if(p==sc->NIL) {
                s_return(sc,sc->F);
           }
@@ -3790,8 +7585,10 @@ case OP_IMAGE:
                case OP_OPEN_INSTRING:     prop=port_input; break;
                case OP_OPEN_INOUTSTRING:  prop=port_input|port_output; break;
           }
-          p=port_from_string(sc, strvalue(car(sc->args)),
-                 strvalue(car(sc->args))+strlength(car(sc->args)), prop);
+          if(prop&port_output) {
+               string_writable(sc,car(sc->args));
+          }
+          p=port_from_string_cell(sc, car(sc->args), prop);
           if(p==sc->NIL) {
                s_return(sc,sc->F);
           }
@@ -3805,9 +7602,8 @@ case OP_IMAGE:
                     s_return(sc,sc->F);
                }
           } else {
-               p=port_from_string(sc, strvalue(car(sc->args)),
-                      strvalue(car(sc->args))+strlength(car(sc->args)),
-                          port_output);
+               string_writable(sc,car(sc->args));
+               p=port_from_string_cell(sc, car(sc->args), port_output);
                if(p==sc->NIL) {
                     s_return(sc,sc->F);
                }
@@ -3818,20 +7614,8 @@ case OP_IMAGE:
           port *p;
 
           if ((p=car(sc->args)->_object._port)->kind&port_string) {
-               off_t size;
-               char *str;
-
-               size=p->rep.string.curr-p->rep.string.start+1;
-               str=sc->malloc(size);
-               if(str != NULL) {
-                    pointer s;
-
-                    memcpy(str,p->rep.string.start,size-1);
-                    str[size-1]='\0';
-                    s=mk_string(sc,str);
-                    sc->free(str);
-                    s_return(sc,s);
-               }
+               s_return(sc,mk_counted_string(sc,p->rep.string.start,
+                                             p->rep.string.curr-p->rep.string.start));
           }
           s_return(sc,sc->F);
      }
@@ -4050,6 +7834,9 @@ static pointer opexe_5(Lax *sc, enum Lax_opcodes op) {
         putstr(sc,"#[");
         sc->args=cons(sc,sc->args,mk_integer(sc,0));
         s_goto(sc,OP_PVECFROM);
+    } else if(is_numvector(sc->args)) {
+        print_numvector(sc,sc->args);
+        s_return(sc,sc->T);
     } else if(is_environment(sc->args)) {
         putstr(sc,"#<ENVIRONMENT>");
         if(sc->interactive_repl) { putstr(sc, "\n"); }
@@ -4111,15 +7898,15 @@ case OP_P1LIST:
     }
 
      case OP_PVECFROM: {
-          int i=ivalue_unchecked(cdr(sc->args));
+          int i=ivalue(cdr(sc->args));
           pointer vec=car(sc->args);
-          int len=ivalue_unchecked(vec);
+          int len=veclen(vec);
           if(i==len) {
                putstr(sc,"]");
                s_return(sc,sc->T);
           } else {
                pointer elem=vector_elem(vec,i);
-               ivalue_unchecked(cdr(sc->args))=i+1;
+               set_cdr(sc, sc->args, mk_integer(sc,i+1));
                s_save(sc,OP_PVECFROM, sc->args, sc->NIL);
                sc->args=elem;
                if (i > 0)
@@ -4179,6 +7966,443 @@ static pointer opexe_6(Lax *sc, enum Lax_opcodes op) {
           s_retbool(is_closure(car(sc->args)));
      case OP_MICROP:
           s_retbool(is_macro(car(sc->args)));
+     case OP_MKEQHASH:
+     case OP_MKEQVHASH:
+     case OP_MKEQUALHASH:
+     case OP_MKSTRHASH: {
+          size_t hint = 0;
+          if (sc->args != sc->NIL) {
+               hint = ivalue(car(sc->args));
+               if (hint > HT_MAX_SIZE) {
+                    Error_1(sc,"hash table: size too large:",car(sc->args));
+               }
+          }
+          s_return(sc,mk_hashtable(sc, op-OP_MKEQHASH, hint));
+     }
+     case OP_HASHP:
+          s_retbool(is_hashtable(car(sc->args)));
+     case OP_HASHSET: {
+          struct hashtab *h = car(sc->args)->_object._hash;
+          if (h->kind == HT_STRING && !is_string(cadr(sc->args))) {
+               Error_1(sc,"hash-table-set!: key must be a string:",cadr(sc->args));
+          }
+          if (h->weak == HT_STRONG) {
+               gc_barrier(sc, car(sc->args), cadr(sc->args));
+          }
+          if (h->weak != HT_EPHEMERON) {
+               gc_barrier(sc, car(sc->args), caddr(sc->args));
+          }
+          ht_set(sc, h, cadr(sc->args), caddr(sc->args));
+          s_return(sc,car(sc->args));
+     }
+     case OP_HASHREF: {
+          pointer *slot = ht_lookup(car(sc->args)->_object._hash, cadr(sc->args));
+          if (slot != 0) {
+               s_return(sc,*slot);
+          } else if (cddr(sc->args) != sc->NIL) {
+               s_return(sc,caddr(sc->args));
+          }
+          s_return(sc,sc->F);
+     }
+     case OP_HASHDEL:
+          s_retbool(ht_delete(sc, car(sc->args)->_object._hash, cadr(sc->args)));
+     case OP_HASHHAS:
+          s_retbool(ht_lookup(car(sc->args)->_object._hash, cadr(sc->args)) != 0);
+     case OP_HASHCOUNT:
+          s_return(sc,mk_integer(sc,car(sc->args)->_object._hash->count));
+     case OP_HASHKEYS:
+          s_return(sc,ht_list(sc, car(sc->args)->_object._hash, 0));
+     case OP_HASH2ALIST:
+          s_return(sc,ht_list(sc, car(sc->args)->_object._hash, 1));
+     case OP_MKWEAKEQHASH:
+     case OP_MKWEAKEQVHASH:
+     case OP_MKWEAKEQUALHASH:
+     case OP_MKEPHEQHASH:
+     case OP_MKEPHEQVHASH:
+     case OP_MKEPHEQUALHASH: {
+          size_t hint = 0;
+          int weak = op < OP_MKEPHEQHASH ? HT_WEAK_KEYS : HT_EPHEMERON;
+          if (sc->args != sc->NIL) {
+               hint = ivalue(car(sc->args));
+               if (hint > HT_MAX_SIZE) {
+                    Error_1(sc,"hash table: size too large:",car(sc->args));
+               }
+          }
+          s_return(sc,mk_weak_hashtable(sc, (op-OP_MKWEAKEQHASH)%3, weak, hint));
+     }
+     case OP_HASHWEAKP:
+          s_retbool(car(sc->args)->_object._hash->weak != HT_STRONG);
+     case OP_MKWEAKBOX:
+          x = mk_weakbox(sc, car(sc->args), sc->F);
+          weak_register(sc, x);
+          s_return(sc,x);
+     case OP_WEAKBOXP:
+          s_retbool(is_weakbox(car(sc->args)));
+     case OP_WEAKBOXVAL:
+          x = car(sc->args);
+          if (cdr(x) == sc->T && cdr(sc->args) != sc->NIL) {
+               s_return(sc,cadr(sc->args));
+          }
+          s_return(sc,car(x));
+     case OP_WEAKBOXBROKEN:
+          s_retbool(cdar(sc->args) == sc->T);
+     case OP_MKGUARDIAN:
+          x = get_cell(sc, sc->NIL, sc->NIL);
+          typeflag(x) = T_GUARDIAN;
+          car(x) = cdr(x) = sc->NIL;
+          weak_register(sc, x);
+          s_return(sc,x);
+     case OP_GUARDIANP:
+          s_retbool(is_guardian(car(sc->args)));
+     case OP_GUARDREG:
+          x = car(sc->args);
+          y = mk_weakbox(sc, cadr(sc->args), cdr(x));
+          gc_barrier(sc, x, y);
+          cdr(x) = y;
+          s_return(sc,sc->T);
+     case OP_GUARDCOLLECT:
+          x = car(sc->args);
+          if (car(x) == sc->NIL) {
+               s_return(sc,sc->F);
+          }
+          y = caar(x);
+          car(x) = cdar(x);
+          s_return(sc,y);
+     case OP_MKRECTYPE: {
+          int i;
+          for (x = sc->args; x != sc->NIL; x = cdr(x)) {
+               if (!is_symbol(car(x)) && !is_string(car(x))) {
+                    Error_1(sc,"make-record-type: names must be symbols or strings:",car(x));
+               }
+          }
+          y = get_vector_object(sc, list_length(sc, sc->args), sc->NIL);
+          if (sc->no_memory) {
+               s_return(sc,sc->sink);
+          }
+          typeflag(y) = (T_RECTYPE | T_ATOM);
+          for (x = sc->args, i = 0; x != sc->NIL; x = cdr(x), i++) {
+               set_vector_elem(sc, y, i, is_string(car(x)) ? mk_symbol(sc, string_cstr(sc, car(x))) : car(x));
+          }
+          s_return(sc,y);
+     }
+     case OP_RECCTOR:
+          s_return(sc,mk_recproc(sc, car(sc->args), RP_CTOR, 0));
+     case OP_RECPRED:
+          s_return(sc,mk_recproc(sc, car(sc->args), RP_PRED, 0));
+     case OP_RECACC:
+     case OP_RECMOD: {
+          int i = rectype_field(sc, car(sc->args), cadr(sc->args));
+          if (i < 0) {
+               Error_1(sc,"record: no such field:",cadr(sc->args));
+          }
+          s_return(sc,mk_recproc(sc, car(sc->args), op == OP_RECACC ? RP_GET : RP_SET, i));
+     }
+     case OP_RECORDP:
+          s_retbool(is_record(car(sc->args)));
+     case OP_RECAPPLY: {
+          pointer rtd = car(sc->code);
+          long d = ivalue(cdr(sc->code));
+          int i;
+          switch (d & 3) {
+          case RP_CTOR:
+               if (list_length(sc, sc->args) != (int)veclen(rtd)-1) {
+                    Error_1(sc,"record constructor: wrong number of fields for",vector_elem(rtd, 0));
+               }
+               y = get_vector_object(sc, veclen(rtd), rtd);
+               if (sc->no_memory) {
+                    s_return(sc,sc->sink);
+               }
+               typeflag(y) = (T_RECORD | T_ATOM);
+               for (x = sc->args, i = 1; x != sc->NIL; x = cdr(x), i++) {
+                    set_vector_elem(sc, y, i, car(x));
+               }
+               s_return(sc,y);
+          case RP_PRED:
+               if (list_length(sc, sc->args) != 1) {
+                    Error_0(sc,"record predicate: needs 1 argument(s)");
+               }
+               s_retbool(is_record(car(sc->args)) && vector_elem(car(sc->args), 0) == rtd);
+          default:
+               if (list_length(sc, sc->args) != ((d & 3) == RP_GET ? 1 : 2)) {
+                    Error_1(sc,"record field: wrong number of arguments for",vector_elem(rtd, d >> 2));
+               }
+               x = car(sc->args);
+               if (!is_record(x) || vector_elem(x, 0) != rtd) {
+                    Error_1(sc,"record field: not a record of type",vector_elem(rtd, 0));
+               }
+               if ((d & 3) == RP_GET) {
+                    s_return(sc,vector_elem(x, d >> 2));
+               }
+               set_vector_elem(sc, x, d >> 2, cadr(sc->args));
+               s_return(sc,x);
+          }
+     }
+     case OP_MKF64VEC:
+     case OP_MKS64VEC:
+     case OP_MKU8VEC: {
+          size_t i, n = ivalue(car(sc->args));
+          if (n > numvec_max_len(T_F64VECTOR+(op-OP_MKF64VEC))) {
+               Error_1(sc,"numvector: length too large:",car(sc->args));
+          }
+          x = mk_numvector(sc, T_F64VECTOR+(op-OP_MKF64VEC), n);
+          if (sc->no_memory) {
+               s_return(sc,sc->sink);
+          }
+          if (cdr(sc->args) != sc->NIL) {
+               for (i = 0; i < n; i++) {
+                    if (!numvec_set(x, i, cadr(sc->args))) {
+                         Error_1(sc,"numvector: value does not fit the element type:",cadr(sc->args));
+                    }
+               }
+          }
+          s_return(sc,x);
+     }
+     case OP_F64VEC:
+     case OP_S64VEC:
+     case OP_U8VEC: {
+          size_t i;
+          x = mk_numvector(sc, T_F64VECTOR+(op-OP_F64VEC), list_length(sc, sc->args));
+          if (sc->no_memory) {
+               s_return(sc,sc->sink);
+          }
+          for (y = sc->args, i = 0; y != sc->NIL; y = cdr(y), i++) {
+               if (!numvec_set(x, i, car(y))) {
+                    Error_1(sc,"numvector: value does not fit the element type:",car(y));
+               }
+          }
+          s_return(sc,x);
+     }
+     case OP_F64VECP:
+     case OP_S64VECP:
+     case OP_U8VECP:
+          s_retbool(type(car(sc->args)) == T_F64VECTOR+(op-OP_F64VECP));
+     case OP_NVLEN:
+          s_return(sc,mk_integer(sc, numvec_len(car(sc->args))));
+     case OP_NVREF:
+          if ((size_t)ivalue(cadr(sc->args)) >= numvec_len(car(sc->args))) {
+               Error_1(sc,"numvector-ref: out of bounds:",cadr(sc->args));
+          }
+          s_return(sc,numvec_ref(sc, car(sc->args), ivalue(cadr(sc->args))));
+     case OP_NVSET:
+          if ((size_t)ivalue(cadr(sc->args)) >= numvec_len(car(sc->args))) {
+               Error_1(sc,"numvector-set!: out of bounds:",cadr(sc->args));
+          }
+          if (!numvec_set(car(sc->args), ivalue(cadr(sc->args)), caddr(sc->args))) {
+               Error_1(sc,"numvector-set!: value does not fit the element type:",caddr(sc->args));
+          }
+          s_return(sc,car(sc->args));
+     case OP_NV2LIST: {
+          size_t i = numvec_len(car(sc->args));
+          y = sc->NIL;
+          while (i-- > 0) {
+               y = cons(sc, numvec_ref(sc, car(sc->args), i), y);
+          }
+          s_return(sc,y);
+     }
+     case OP_NVADD:
+     case OP_NVMUL:
+     case OP_NVDOT: {
+          pointer a = car(sc->args), b = cadr(sc->args);
+          size_t n = numvec_len(a);
+          void *pa = numvec_data(a), *pb = numvec_data(b);
+          if (type(a) != type(b) || n != numvec_len(b)) {
+               Error_1(sc,"numvector: vectors differ in type or length:",b);
+          }
+          if (op == OP_NVDOT) {
+               switch (type(a)) {
+               case T_F64VECTOR:
+                    s_return(sc,mk_real(sc, nv_dot_f64(pa, pb, n)));
+               case T_S64VECTOR:
+                    s_return(sc,mk_integer(sc, (long)nv_dot_u64(pa, pb, n)));
+               default:
+                    s_return(sc,mk_integer(sc, nv_dot_u8(pa, pb, n)));
+               }
+          }
+          x = mk_numvector(sc, type(a), n);
+          if (sc->no_memory) {
+               s_return(sc,sc->sink);
+          }
+          switch (type(a)) {
+          case T_F64VECTOR:
+               if (op == OP_NVADD) NV_MAP(double, nv_f64, numvec_data(x), pa, pb, n, +);
+               else NV_MAP(double, nv_f64, numvec_data(x), pa, pb, n, *);
+               break;
+          case T_S64VECTOR:
+               if (op == OP_NVADD) NV_MAP(unsigned long long, nv_u64, numvec_data(x), pa, pb, n, +);
+               else NV_MAP(unsigned long long, nv_u64, numvec_data(x), pa, pb, n, *);
+               break;
+          default:
+               if (op == OP_NVADD) NV_MAP(unsigned char, nv_u8, numvec_data(x), pa, pb, n, +);
+               else NV_MAP(unsigned char, nv_u8, numvec_data(x), pa, pb, n, *);
+               break;
+          }
+          s_return(sc,x);
+     }
+     case OP_NVSCALE: {
+          pointer a = car(sc->args), k = cadr(sc->args);
+          size_t n = numvec_len(a);
+          if (!is_f64vector(a) && !is_integer(k)) {
+               Error_1(sc,"numvector-scale: integer vectors need an integer factor:",k);
+          }
+          if (!is_f64vector(a) && is_bignum(k)) {
+               Error_1(sc,"numvector-scale: factor out of range:",k);
+          }
+          x = mk_numvector(sc, type(a), n);
+          if (sc->no_memory) {
+               s_return(sc,sc->sink);
+          }
+          switch (type(a)) {
+          case T_F64VECTOR:
+               NV_SCALE(double, nv_f64, numvec_data(x), numvec_data(a), n, rvalue(k));
+               break;
+          case T_S64VECTOR:
+               NV_SCALE(unsigned long long, nv_u64, numvec_data(x), numvec_data(a), n, (unsigned long long)ivalue(k));
+               break;
+          default:
+               NV_SCALE(unsigned char, nv_u8, numvec_data(x), numvec_data(a), n, (unsigned char)ivalue(k));
+               break;
+          }
+          s_return(sc,x);
+     }
+     case OP_NVSUM:
+          x = car(sc->args);
+          switch (type(x)) {
+          case T_F64VECTOR:
+               s_return(sc,mk_real(sc, nv_sum_f64(numvec_data(x), numvec_len(x))));
+          case T_S64VECTOR:
+               s_return(sc,mk_integer(sc, (long)nv_sum_u64(numvec_data(x), numvec_len(x))));
+          default:
+               s_return(sc,mk_integer(sc, nv_sum_u8(numvec_data(x), numvec_len(x))));
+          }
+     case OP_NVMIN:
+     case OP_NVMAX:
+          x = car(sc->args);
+          if (numvec_len(x) == 0) {
+               Error_1(sc,"numvector: empty vector:",x);
+          }
+          s_return(sc,numvec_ref(sc, x, nv_extreme(x, op == OP_NVMAX)));
+     case OP_BVP:
+          s_retbool(is_u8vector(car(sc->args)));
+     case OP_MKBV:
+     case OP_BV:
+          s_goto(sc,op == OP_MKBV ? OP_MKU8VEC : OP_U8VEC);
+     case OP_BVLEN:
+          s_goto(sc,OP_NVLEN);
+     case OP_BVREF:
+          s_goto(sc,OP_NVREF);
+     case OP_BVSET:
+          s_goto(sc,OP_NVSET);
+     case OP_BVCOPY:
+     case OP_UTF82STR: {
+          size_t start, end;
+          x = car(sc->args);
+          if (!bv_range(sc, cdr(sc->args), numvec_len(x), &start, &end)) {
+               Error_1(sc,"bytevector: bad range for",x);
+          }
+          if (op == OP_UTF82STR) {
+               s_return(sc,mk_counted_string(sc, (char*)numvec_data(x)+start, end-start));
+          }
+          y = mk_numvector(sc, T_U8VECTOR, end-start);
+          if (sc->no_memory) {
+               s_return(sc,sc->sink);
+          }
+          memcpy(numvec_data(y), (char*)numvec_data(x)+start, end-start);
+          s_return(sc,y);
+     }
+     case OP_BVCOPYB: {
+          size_t at = ivalue(cadr(sc->args)), start, end;
+          x = car(sc->args);
+          y = caddr(sc->args);
+          if (!bv_range(sc, cdr(cddr(sc->args)), numvec_len(y), &start, &end)
+              || at > numvec_len(x) || end-start > numvec_len(x)-at) {
+               Error_1(sc,"bytevector-copy!: bad range for",y);
+          }
+          memmove((char*)numvec_data(x)+at, (char*)numvec_data(y)+start, end-start);
+          s_return(sc,x);
+     }
+     case OP_STR2UTF8:
+          x = mk_numvector(sc, T_U8VECTOR, strlength(car(sc->args)));
+          if (sc->no_memory) {
+               s_return(sc,sc->sink);
+          }
+          memcpy(numvec_data(x), strvalue(car(sc->args)), strlength(car(sc->args)));
+          s_return(sc,x);
+     case OP_OPEN_BININFILE:
+     case OP_OPEN_BINOUTFILE:
+          x = port_from_filename(sc, string_cstr(sc, car(sc->args)),
+                 (op == OP_OPEN_BININFILE ? port_input : port_output)|port_binary);
+          if (x == sc->NIL) {
+               s_return(sc,sc->F);
+          }
+          s_return(sc,x);
+     case OP_READ_U8:
+     case OP_PEEK_U8: {
+          port *pt = (sc->args != sc->NIL ? car(sc->args) : sc->inport)->_object._port;
+          unsigned char b;
+          if (port_read_block(pt, (char*)&b, 1) == 0) {
+               s_return(sc,sc->EOF_OBJ);
+          }
+          if (op == OP_PEEK_U8) {
+               if (pt->kind&port_file) {
+                    ungetc(b, pt->rep.stdio.file);
+               } else {
+                    pt->rep.string.curr--;
+               }
+          }
+          s_return(sc,mk_integer(sc, b));
+     }
+     case OP_WRITE_U8: {
+          port *pt = (cdr(sc->args) != sc->NIL ? cadr(sc->args) : sc->outport)->_object._port;
+          unsigned char b = (unsigned char)ivalue(car(sc->args));
+          if (ivalue(car(sc->args)) > 255) {
+               Error_1(sc,"write-u8: not a byte:",car(sc->args));
+          }
+          port_write_block(sc, pt, (char*)&b, 1);
+          s_return(sc,sc->T);
+     }
+     case OP_READ_BV: {
+          port *pt = (cdr(sc->args) != sc->NIL ? cadr(sc->args) : sc->inport)->_object._port;
+          size_t n = ivalue(car(sc->args)), got;
+          if (n > numvec_max_len(T_U8VECTOR)) {
+               Error_1(sc,"read-bytevector: length too large:",car(sc->args));
+          }
+          x = mk_numvector(sc, T_U8VECTOR, n);
+          if (sc->no_memory) {
+               s_return(sc,sc->sink);
+          }
+          got = port_read_block(pt, numvec_data(x), n);
+          if (got == 0 && n > 0) {
+               s_return(sc,sc->EOF_OBJ);
+          }
+          sc->large_bytes -= n-got;
+          numvec_len(x) = got;
+          s_return(sc,x);
+     }
+     case OP_READ_BVB:
+     case OP_WRITE_BV: {
+          size_t start, end, done;
+          port *pt;
+          x = car(sc->args);
+          y = cdr(sc->args);
+          if (y != sc->NIL) {
+               pt = car(y)->_object._port;
+               y = cdr(y);
+          } else {
+               pt = (op == OP_READ_BVB ? sc->inport : sc->outport)->_object._port;
+          }
+          if (!bv_range(sc, y, numvec_len(x), &start, &end)) {
+               Error_1(sc,"bytevector: bad range for",x);
+          }
+          if (op == OP_WRITE_BV) {
+               port_write_block(sc, pt, (char*)numvec_data(x)+start, end-start);
+               s_return(sc,sc->T);
+          }
+          done = port_read_block(pt, (char*)numvec_data(x)+start, end-start);
+          if (done == 0 && end > start) {
+               s_return(sc,sc->EOF_OBJ);
+          }
+          s_return(sc,mk_integer(sc, done));
+     }
      default:
           snprintf(sc->strbuff,STRBUFFSIZE,"%d: illegal operator", sc->op);
           Error_0(sc,sc->strbuff);
@@ -4191,8 +8415,9 @@ typedef pointer (*dispatch_func)(Lax *, enum Lax_opcodes);
 typedef int (*test_predicate)(pointer);
 static int is_any(pointer p) { return 1;}
 
+/* a bignum is never a valid index or count */
 static int is_nonneg(pointer p) {
-  return ivalue(p)>=0 && is_integer(p);
+  return !is_bignum(p) && ivalue(p)>=0 && is_integer(p);
 }
 
 static struct {
@@ -4213,7 +8438,13 @@ static struct {
   {is_vector, "vector"},
   {is_number, "number"},
   {is_integer, "integer"},
-  {is_nonneg, "non-negative integer"}
+  {is_nonneg, "non-negative integer"},
+  {is_hashtable, "hash table"},
+  {is_rectype, "record type"},
+  {is_numvector, "numeric vector"},
+  {is_u8vector, "bytevector"},
+  {is_weakbox, "weak box"},
+  {is_guardian, "guardian"}
 };
 
 #define TST_NONE 0
@@ -4231,6 +8462,12 @@ static struct {
 #define TST_NUMBER "\014"
 #define TST_INTEGER "\015"
 #define TST_NATURAL "\016"
+#define TST_HASHTABLE "\017"
+#define TST_RECTYPE "\020"
+#define TST_NUMVEC "\021"
+#define TST_BYTEVEC "\022"
+#define TST_WEAKBOX "\023"
+#define TST_GUARDIAN "\024"
 
 typedef struct {
   dispatch_func func;
@@ -4258,6 +8495,8 @@ static const char *procname(pointer x) {
 }
 
 static void Eval_Cycle(Lax *sc, enum Lax_opcodes op) {
+  pointer x;
+
   sc->op = op;
   for (;;) {
     op_code_info *pcd=dispatch_table+sc->op;
@@ -4318,7 +8557,39 @@ static void Eval_Cycle(Lax *sc, enum Lax_opcodes op) {
       }
     }
     ok_to_freely_gc(sc);
-    if (pcd->func(sc, (enum Lax_opcodes)sc->op) == sc->NIL) {
+#if USE_HEAP_QUOTAS
+    if (sc->quota_gc) {
+      gc_squeeze(sc, sc->NIL, sc->NIL);
+    }
+#endif
+#if USE_INCREMENTAL_GC
+    if (sc->gc_phase == GC_IDLE
+        ? sc->fcells < (sc->last_cell_seg + 1) * (CELL_SEGSIZE/4)
+        : sc->gc_debt >= GC_STEP_CELLS) {
+      gc_step(sc);
+    }
+#endif
+#if USE_HEAP_QUOTAS
+    sc->quota_dump = sc->dump;
+    sc->quota_envir = sc->envir;
+#endif
+    x = pcd->func(sc, (enum Lax_opcodes)sc->op);
+#if USE_HEAP_QUOTAS
+    if (sc->no_memory && sc->over_quota && !sc->quota_grace) {
+      /* the instance survives: the error replaces the opcode, so what
+         the hook returns goes where the opcode's value would have */
+      sc->no_memory = 0;
+      sc->over_quota = 0;
+      sc->quota_grace = 1;
+      sc->dump = sc->quota_dump;
+      sc->envir = sc->quota_envir;
+      if (_Error_1(sc, "out of memory: heap quota exceeded", 0) == sc->NIL) {
+        return;
+      }
+      continue;
+    }
+#endif
+    if (x == sc->NIL) {
       return;
     }
     if(sc->no_memory) {
@@ -4393,6 +8664,8 @@ static int syntaxnum(pointer p) {
           default: return OP_LET0REC;
           }
      default:
+          if(strcmp(s, "receive") == 0) return OP_RECEIVE0;
+          if(strcmp(s, "let-values") == 0) return OP_LETV0;
           return OP_C0STREAM;
      }
 }
@@ -4435,7 +8708,7 @@ static struct Lax_interface vtbl ={
   is_list,
   is_vector,
   list_length,
-  ivalue,
+  vector_length,
   fill_vector,
   vector_elem,
   set_vector_elem,
@@ -4503,6 +8776,8 @@ lax_help(Lax *sc, pointer args)
     puts("  let           - Create a temporary environment with new bindings");
     puts("  let$          - Create a chain of dependent bindings");
     puts("  let*          - Let bindings reference each other");
+    puts("  receive       - Bind the values of an expression to formals");
+    puts("  let-values    - Let whose bindings each take several values");
     puts("  chlet         - Selects the first suitable branch");
     puts("  chlet-stream  - Create a lazy pair");
     puts("  micro         - Changes code before execution");
@@ -4544,6 +8819,8 @@ lax_help(Lax *sc, pointer args)
     puts("Call and functions:");
     puts("  apply         - Apply procedure to list of args");
     puts("  eval          - Evaluate Lax expression in current environment");
+    puts("  values        - Return any number of values without building a list");
+    puts("  call-with-values - Call consumer with the values of producer");
     puts("  map           - Map function over list(s), return new list");
     puts("  for-each      - Apply function to list elements for side-effects (no result list)");
     puts("--- Low-level/auxiliary (functions and commands) ---");
@@ -4648,6 +8925,57 @@ lax_help(Lax *sc, pointer args)
     puts("  vector-set!   - Write vector element");
     puts("  vector-length - Length");
     puts("");
+    puts("Hash tables:");
+    puts("  make-eq-hash-table     - Table keyed by identity");
+    puts("  make-eqv-hash-table    - Table keyed by eqv?");
+    puts("  make-equal-hash-table  - Table keyed by structure");
+    puts("  make-string-hash-table - Table keyed by string contents");
+    puts("  hash-table-set!        - Store a value under a key");
+    puts("  hash-table-ref         - Value for key, or default / #f");
+    puts("  hash-table-delete!     - Remove a key");
+    puts("  hash-table-contains?   - Test for a key");
+    puts("  hash-table-count       - Number of entries");
+    puts("  hash-table-keys        - List of keys");
+    puts("  hash-table->alist      - List of (key . value) pairs");
+    puts("");
+    puts("Records:");
+    puts("  make-record-type   - New record type from a name and field names");
+    puts("  record-constructor - Procedure building a record from all fields");
+    puts("  record-predicate   - Procedure testing for the record type");
+    puts("  record-accessor    - Procedure reading a named field");
+    puts("  record-modifier    - Procedure writing a named field");
+    puts("  record?            - Test if value is a record");
+    puts("");
+    puts("Numeric vectors:");
+    puts("  make-f64vector     - Unboxed vector of doubles (also s64, u8)");
+    puts("  f64vector          - Build from arguments (also s64vector, u8vector)");
+    puts("  f64vector?         - Type tests (also s64vector?, u8vector?)");
+    puts("  numvector-length   - Number of elements");
+    puts("  numvector-ref      - Element at index");
+    puts("  numvector-set!     - Store element at index");
+    puts("  numvector->list    - List of elements");
+    puts("  numvector-add      - Element-wise sum of two vectors");
+    puts("  numvector-mul      - Element-wise product of two vectors");
+    puts("  numvector-scale    - Multiply every element by a number");
+    puts("  numvector-sum      - Sum of the elements");
+    puts("  numvector-min      - Smallest element");
+    puts("  numvector-max      - Largest element");
+    puts("  numvector-dot      - Dot product of two vectors");
+    puts("");
+    puts("Bytevectors (u8 vectors):");
+    puts("  make-bytevector         - New bytevector, optionally filled");
+    puts("  bytevector-u8-ref       - Byte at index (also -u8-set!, -length)");
+    puts("  bytevector-copy         - Copy of a range");
+    puts("  bytevector-copy!        - Copy a range into another bytevector");
+    puts("  utf8->string            - String from bytes (also string->utf8)");
+    puts("  open-binary-input-file  - Open a file for binary reading");
+    puts("  open-binary-output-file - Open a file for binary writing");
+    puts("  read-u8 / peek-u8       - Next byte from a port");
+    puts("  write-u8                - Write one byte");
+    puts("  read-bytevector         - Read up to k bytes in one block");
+    puts("  read-bytevector!        - Read into an existing bytevector");
+    puts("  write-bytevector        - Write a bytevector in one block");
+    puts("");
     puts("Streams:");
     puts("  tarry         - Wait for the specified time before executing");
     puts("  stream        - helpers > map/for-each variants for streams");
@@ -4724,15 +9052,86 @@ int Lax_init_custom_alloc(Lax *sc, func_alloc malloc, func_dealloc free) {
   sc->paren_error_printed=0;
   sc->malloc=malloc;
   sc->free=free;
+  sc->alloc_seg = 0;
+  sc->cell_seg = 0;
+  sc->seg_cap = 0;
   sc->last_cell_seg = -1;
+#if USE_MMAP_HEAP
+  heap_reserve(sc);
+#endif
+#if USE_SEG_BLOCKS
+  x = (pointer)alloc_seg_block(sc, &sc->const_seg);
+  if (x == 0) {
+    sc->no_memory=1;
+    return 0;
+  }
+#if USE_MARK_BITMAP
+  memset(seg_marks(x), 0, SEG_MARKBYTES);
+#endif
+  x += CELL_SEGHDR;
+  sc->sink = x++;
+  sc->NIL = x++;
+  sc->T = x++;
+  sc->F = x++;
+  sc->EOF_OBJ = x++;
+  sc->VALUES = x;
+#else
   sc->sink = &sc->_sink;
   sc->NIL = &sc->_NIL;
   sc->T = &sc->_HASHT;
   sc->F = &sc->_HASHF;
   sc->EOF_OBJ=&sc->_EOF_OBJ;
-  sc->free_cell = &sc->_NIL;
+  sc->VALUES=&sc->_VALUES;
+#endif
+  sc->free_cell = sc->NIL;
   sc->fcells = 0;
+  sc->large_bytes = 0;
+  sc->large_limit = LARGE_GC_MIN;
+#if USE_HEAP_QUOTAS
+  sc->str_bytes = 0;
+  sc->over_quota = sc->quota_grace = sc->quota_gc = sc->squeezing = 0;
+  sc->quota_dump = sc->quota_envir = sc->NIL;
+  Lax_set_heap_limits(sc, 0, 0);
+#endif
+  values_clear(sc);
+#if USE_LAZY_SWEEP
+  sc->gc_phase = GC_IDLE;
+#endif
+#if USE_FINALIZER_THREAD
+  fin_init(sc);
+#endif
+#if USE_PARALLEL_MARK
+  sc->gc_threads = GC_MARK_THREADS;
+#ifdef _SC_NPROCESSORS_ONLN
+  if (sc->gc_threads == 0) {
+    sc->gc_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+#endif
+#endif
+#if USE_INCREMENTAL_GC
+  sc->gray = 0;
+  sc->gray_top = sc->gray_size = 0;
+  sc->gc_debt = 0;
+  sc->gc_pause_us = GC_PAUSE_USEC;
+#endif
   sc->no_memory=0;
+#if USE_HEAP_REGIONS
+  sc->region = 0;
+  sc->old_segs = 0;
+#endif
+  sc->recent = (pointer*)sc->malloc(RECENT_ROOTS*sizeof(pointer));
+  if (sc->recent == 0) {
+    sc->no_memory=1;
+    return 0;
+  }
+  sc->nrecent = sc->recent_base = 0;
+  sc->recent_cap = RECENT_ROOTS;
+  sc->weak = 0;
+  sc->nweak = sc->weak_cap = 0;
+#if USE_STRING_SLABS
+  memset(sc->str_free, 0, sizeof(sc->str_free));
+  sc->str_slabs = 0;
+#endif
   sc->inport=sc->NIL;
   sc->outport=sc->NIL;
   sc->save_inport=sc->NIL;
@@ -4744,6 +9143,10 @@ int Lax_init_custom_alloc(Lax *sc, func_alloc malloc, func_dealloc free) {
     sc->no_memory=1;
     return 0;
   }
+#if USE_GENERATIONAL_GC
+  gen_cursor(sc, 0);
+  gen_reset(sc);
+#endif
   sc->gc_verbose = 0;
   dump_stack_initialize(sc);
   sc->code = sc->NIL;
@@ -4755,9 +9158,20 @@ int Lax_init_custom_alloc(Lax *sc, func_alloc malloc, func_dealloc free) {
   car(sc->T) = cdr(sc->T) = sc->T;
   typeflag(sc->F) = (T_ATOM | MARK);
   car(sc->F) = cdr(sc->F) = sc->F;
+  typeflag(sc->VALUES) = (T_ATOM | MARK);
+  car(sc->VALUES) = cdr(sc->VALUES) = sc->NIL;
   typeflag(sc->sink) = (T_PAIR | MARK);
   car(sc->sink) = sc->NIL;
+#if USE_MARK_BITMAP
+  setmark(sc->NIL);
+  setmark(sc->T);
+  setmark(sc->F);
+  setmark(sc->VALUES);
+  setmark(sc->sink);
+#endif
   sc->c_nest = sc->NIL;
+  sc->oblist = sc->global_env = sc->NIL;
+  sc->args = sc->envir = sc->value = sc->NIL;
 
   sc->oblist = oblist_initial_value(sc);
   new_frame_in_env(sc, sc->NIL);
@@ -4774,6 +9188,8 @@ int Lax_init_custom_alloc(Lax *sc, func_alloc malloc, func_dealloc free) {
   assign_syntax(sc, "let");
   assign_syntax(sc, "let$");
   assign_syntax(sc, "let*");
+  assign_syntax(sc, "receive");
+  assign_syntax(sc, "let-values");
   assign_syntax(sc, "chlet");
   assign_syntax(sc, "and");
   assign_syntax(sc, "or");
@@ -4825,6 +9241,280 @@ void Lax_set_external_data(Lax *sc, void *p) {
  sc->ext_data=p;
 }
 
+#if USE_HEAP_REGIONS
+/* Lax_checkpoint() keeps an image of the heap after a full collection,
+   and Lax_reset() drops every segment added since and copies the image
+   back over the segments that changed.  While a checkpoint is kept the
+   collector neither sweeps its segments nor allocates from their free
+   cells.  What an old cell owns outside the heap is copied aside too:
+   the elements of a large vector, number vector data and hash table
+   slots.  Old string buffers hold an extra reference, so writing to one
+   copies it first.  Ports keep their state. */
+
+#if USE_SEG_BLOCKS
+#define seg_image(sc,i)  ((char*)((sc)->cell_seg[i] - CELL_SEGHDR))
+#define SEG_IMAGE_BYTES  CELL_SEGBYTES
+#else
+#define seg_image(sc,i)  ((char*)(sc)->cell_seg[i])
+#define SEG_IMAGE_BYTES  (CELL_SEGSIZE*sizeof(struct cell))
+#endif
+
+struct region_copy {
+  pointer cell;
+  pointer *data;
+  size_t bytes;
+  struct hashtab ht;
+};
+
+struct region {
+  char *image;          /* the checkpoint's segments, back to back */
+  char **pins;          /* string buffers it holds a reference to */
+  long npins;
+  struct region_copy *copies;
+  long ncopies;
+  pointer *weak;        /* sc->weak as it was */
+  long nweak;
+  pointer oblist, global_env, envir, code, args, dump, value, c_nest;
+  pointer inport, outport, save_inport, loadport;
+};
+
+/* bytes an old cell owns outside the heap */
+static size_t region_payload(pointer p) {
+  if (has_slots(p) && vecelems(p)) {
+    return veclen(p)*sizeof(pointer);
+  } else if (is_numvector(p)) {
+    return numvec_len(p)*numvec_esize(p);
+  } else if (is_hashtable(p)) {
+    struct hashtab *h = p->_object._hash;
+    return 2*(h->size + h->old_size)*sizeof(pointer);
+  }
+  return 0;
+}
+
+static int region_save(Lax *sc, struct region_copy *c, pointer p) {
+  c->cell = p;
+  c->bytes = region_payload(p);
+  c->data = (pointer*)sc->malloc(c->bytes);
+  if (c->data == 0) {
+    return 0;
+  }
+  if (is_hashtable(p)) {
+    struct hashtab *h = p->_object._hash;
+    c->ht = *h;
+    memcpy(c->data, h->keys, 2*h->size*sizeof(pointer));
+    if (h->old_keys != 0) {
+      memcpy(c->data + 2*h->size, h->old_keys, 2*h->old_size*sizeof(pointer));
+    }
+  } else if (is_numvector(p)) {
+    memcpy(c->data, numvec_data(p), c->bytes);
+  } else {
+    memcpy(c->data, vecelems(p), c->bytes);
+  }
+  return 1;
+}
+
+static void region_restore(Lax *sc, struct region_copy *c) {
+  pointer p = c->cell;
+
+  if (is_hashtable(p)) {
+    struct hashtab *h = p->_object._hash;
+    struct hashtab *s = &c->ht;
+    if (h->keys != s->keys || h->size != s->size
+        || h->old_keys != s->old_keys || h->old_size != s->old_size) {
+      /* rehashed since: new slot arrays */
+      ht_free_slots(sc, h->keys, h->size);
+      ht_free_slots(sc, h->old_keys, h->old_size);
+      s->keys = ht_alloc_slots(sc, s->size);
+      s->old_keys = s->old_size ? ht_alloc_slots(sc, s->old_size) : 0;
+      s->vals = s->keys ? s->keys + s->size : 0;
+      s->old_vals = s->old_keys ? s->old_keys + s->old_size : 0;
+    }
+    *h = *s;
+    if (h->keys != 0) {
+      memcpy(h->keys, c->data, 2*h->size*sizeof(pointer));
+    }
+    if (h->old_keys != 0) {
+      memcpy(h->old_keys, c->data + 2*h->size, 2*h->old_size*sizeof(pointer));
+    }
+  } else if (is_numvector(p)) {
+    memcpy(numvec_data(p), c->data, c->bytes);
+  } else {
+    memcpy(vecelems(p), c->data, c->bytes);
+  }
+}
+
+/* let go of (d < 0) or take (d > 0) the buffers of a segment's strings */
+static void region_strings(Lax *sc, pointer seg, int d) {
+  pointer p;
+
+  for (p = seg; p < seg + CELL_SEGSIZE; p++) {
+    if (typeflag(p) != 0 && is_string(p) && !is_inline_string(p)) {
+      if (d < 0) {
+        release_strbuf(sc, strbuf(p));
+      } else {
+        strbuf_refs(strbuf(p))++;
+      }
+    }
+  }
+}
+
+static void region_drop(Lax *sc) {
+  struct region *r = sc->region;
+  long k;
+
+  if (r == 0) {
+    return;
+  }
+  for (k = 0; k < r->npins; k++) {
+    release_strbuf(sc, r->pins[k]);
+  }
+  for (k = 0; k < r->ncopies; k++) {
+    sc->free(r->copies[k].data);
+  }
+  sc->free(r->copies);
+  sc->free(r->weak);
+  sc->free(r->pins);
+  sc->free(r->image);
+  sc->free(r);
+  sc->region = 0;
+  sc->old_segs = 0;
+}
+
+int Lax_checkpoint(Lax *sc) {
+  struct region *r;
+  long npins = 0, ncopies = 0;
+  int i, n;
+  pointer p;
+
+  region_drop(sc);
+  gc(sc, sc->NIL, sc->NIL);
+  n = sc->last_cell_seg + 1;
+  for (i = 0; i < n; i++) {
+    for (p = sc->cell_seg[i]; p < sc->cell_seg[i] + CELL_SEGSIZE; p++) {
+      if (typeflag(p) == 0) {
+        continue;
+      }
+      if (is_string(p) && !is_inline_string(p)) {
+        npins++;
+      } else if (region_payload(p) != 0) {
+        ncopies++;
+      }
+    }
+  }
+  r = (struct region*)sc->malloc(sizeof(struct region));
+  if (r == 0) {
+    return 0;
+  }
+  r->image = (char*)sc->malloc((size_t)n*SEG_IMAGE_BYTES);
+  r->pins = (char**)sc->malloc((npins+1)*sizeof(char*));
+  r->copies = (struct region_copy*)sc->malloc((ncopies+1)*sizeof(struct region_copy));
+  r->weak = (pointer*)sc->malloc((sc->nweak+1)*sizeof(pointer));
+  r->npins = r->ncopies = 0;
+  sc->region = r;
+  if (r->image == 0 || r->pins == 0 || r->copies == 0 || r->weak == 0) {
+    region_drop(sc);
+    return 0;
+  }
+  for (i = 0; i < n; i++) {
+    for (p = sc->cell_seg[i]; p < sc->cell_seg[i] + CELL_SEGSIZE; p++) {
+      if (typeflag(p) == 0) {
+        continue;
+      }
+      if (is_string(p) && !is_inline_string(p)) {
+        strbuf_refs(strbuf(p))++;
+        r->pins[r->npins++] = strbuf(p);
+      } else if (region_payload(p) != 0) {
+        if (!region_save(sc, &r->copies[r->ncopies], p)) {
+          region_drop(sc);
+          return 0;
+        }
+        r->ncopies++;
+      }
+    }
+    memcpy(r->image + (size_t)i*SEG_IMAGE_BYTES, seg_image(sc,i), SEG_IMAGE_BYTES);
+  }
+  if (sc->nweak) {
+    memcpy(r->weak, sc->weak, sc->nweak*sizeof(pointer));
+  }
+  r->nweak = sc->nweak;
+  r->oblist = sc->oblist;
+  r->global_env = sc->global_env;
+  r->envir = sc->envir;
+  r->code = sc->code;
+  r->args = sc->args;
+  r->dump = sc->dump;
+  r->value = sc->value;
+  r->c_nest = sc->c_nest;
+  r->inport = sc->inport;
+  r->outport = sc->outport;
+  r->save_inport = sc->save_inport;
+  r->loadport = sc->loadport;
+  sc->old_segs = n;
+  sc->free_cell = sc->NIL;
+  sc->fcells = 0;
+  alloc_cellseg(sc, FIRST_CELLSEGS);
+  return 1;
+}
+
+/* Call it between evaluations, not from inside a foreign function. */
+int Lax_reset(Lax *sc) {
+  struct region *r = sc->region;
+  long k;
+  int i;
+  pointer p;
+
+  if (r == 0) {
+    return 0;
+  }
+  sc->free_cell = sc->NIL;
+  sc->fcells = 0;
+  for (i = sc->last_cell_seg; i >= sc->old_segs; i--) {
+    for (p = sc->cell_seg[i]; p < sc->cell_seg[i] + CELL_SEGSIZE; p++) {
+      if (typeflag(p) != 0) {
+        finalize_cell(sc, p);
+      }
+    }
+    if (i - sc->old_segs < FIRST_CELLSEGS) {
+      seg_init_free(sc, sc->cell_seg[i]);
+    } else {
+      free_seg(sc, sc->alloc_seg[i]);
+      sc->last_cell_seg--;
+    }
+  }
+  for (i = 0; i < sc->old_segs; i++) {
+    char *image = r->image + (size_t)i*SEG_IMAGE_BYTES;
+    if (memcmp(seg_image(sc,i), image, SEG_IMAGE_BYTES) != 0) {
+      region_strings(sc, sc->cell_seg[i], -1);
+      memcpy(seg_image(sc,i), image, SEG_IMAGE_BYTES);
+      region_strings(sc, sc->cell_seg[i], 1);
+    }
+  }
+  for (k = 0; k < r->ncopies; k++) {
+    region_restore(sc, &r->copies[k]);
+  }
+  if (r->nweak) {
+    memcpy(sc->weak, r->weak, r->nweak*sizeof(pointer));
+  }
+  sc->nweak = r->nweak;
+  sc->oblist = r->oblist;
+  sc->global_env = r->global_env;
+  sc->envir = r->envir;
+  sc->code = r->code;
+  sc->args = r->args;
+  sc->dump = r->dump;
+  sc->value = r->value;
+  sc->c_nest = r->c_nest;
+  sc->inport = r->inport;
+  sc->outport = r->outport;
+  sc->save_inport = r->save_inport;
+  sc->loadport = r->loadport;
+  values_clear(sc);
+  sc->nrecent = sc->recent_base = 0;
+  gc_release_flush(sc);
+  return 1;
+}
+#endif
+
 void Lax_deinit(Lax *sc) {
   int i;
 
@@ -4832,6 +9522,9 @@ void Lax_deinit(Lax *sc) {
   char *fname;
 #endif
 
+#if USE_HEAP_REGIONS
+  region_drop(sc);
+#endif
   sc->oblist=sc->NIL;
   sc->global_env=sc->NIL;
   dump_stack_free(sc);
@@ -4839,6 +9532,7 @@ void Lax_deinit(Lax *sc) {
   sc->code=sc->NIL;
   sc->args=sc->NIL;
   sc->value=sc->NIL;
+  sc->nrecent=0;
   if(is_port(sc->inport)) {
     typeflag(sc->inport) = T_ATOM;
   }
@@ -4854,10 +9548,44 @@ void Lax_deinit(Lax *sc) {
   sc->loadport=sc->NIL;
   sc->gc_verbose=0;
   gc(sc,sc->NIL,sc->NIL);
+#if USE_LAZY_SWEEP
+  gc_finish(sc);
+#endif
+#if USE_FINALIZER_THREAD
+  fin_deinit(sc);
+#endif
+#if USE_INCREMENTAL_GC
+  if (sc->gray != 0) {
+    sc->free(sc->gray);
+  }
+#endif
 
   for(i=0; i<=sc->last_cell_seg; i++) {
-    sc->free(sc->alloc_seg[i]);
+    free_seg(sc, sc->alloc_seg[i]);
+  }
+  if (sc->seg_cap) {
+    sc->free(sc->alloc_seg);
+    sc->free(sc->cell_seg);
+  }
+  sc->free(sc->recent);
+  if (sc->weak != 0) {
+    sc->free(sc->weak);
+  }
+#if USE_STRING_SLABS
+  while (sc->str_slabs != 0) {
+    char *slab = sc->str_slabs;
+    sc->str_slabs = *(char**)slab;
+    sc->free(slab);
   }
+#endif
+#if USE_SEG_BLOCKS
+  free_seg(sc, sc->const_seg);
+#endif
+#if USE_MMAP_HEAP
+  if (sc->heap_lo != 0) {
+    munmap(sc->heap_lo, sc->heap_hi - sc->heap_lo);
+  }
+#endif
 
 #if SHOW_ERROR_LINE
   for(i=0; i<=sc->file_i; i++) {
@@ -4967,16 +9695,18 @@ void save_from_C_call(Lax *sc)
 {
   pointer saved_data =
     cons(sc,
-         car(sc->sink),
+         mk_integer(sc, sc->recent_base),
          cons(sc,
               sc->envir,
               sc->dump));
   sc->c_nest = cons(sc, saved_data, sc->c_nest);
+  sc->recent_base = sc->nrecent;
   dump_stack_reset(sc);
 }
 void restore_from_C_call(Lax *sc)
 {
-  car(sc->sink) = caar(sc->c_nest);
+  sc->nrecent = sc->recent_base;
+  sc->recent_base = ivalue(caar(sc->c_nest));
   sc->envir = cadar(sc->c_nest);
   sc->dump = cdr(cdar(sc->c_nest));
   sc->c_nest = cdr(sc->c_nest);
@@ -99,6 +99,62 @@ extern "C" {
 # define SHOW_ERROR_LINE 1
 #endif
 
+#ifndef USE_IMMEDIATES
+# define USE_IMMEDIATES 1
+#endif
+
+#ifndef USE_COMPACT_CELLS
+# define USE_COMPACT_CELLS 0
+#endif
+
+#ifndef USE_GENERATIONAL_GC
+# define USE_GENERATIONAL_GC 0
+#endif
+
+#ifndef USE_INCREMENTAL_GC
+# define USE_INCREMENTAL_GC 0
+#endif
+
+#ifndef USE_LAZY_SWEEP
+# define USE_LAZY_SWEEP USE_INCREMENTAL_GC
+#endif
+
+#ifndef USE_MARK_BITMAP
+# define USE_MARK_BITMAP 0
+#endif
+
+#ifndef USE_PARALLEL_MARK
+# define USE_PARALLEL_MARK 0
+#endif
+
+#ifndef USE_FINALIZER_THREAD
+# define USE_FINALIZER_THREAD 0
+#endif
+
+#ifndef USE_MMAP_HEAP
+# define USE_MMAP_HEAP 0
+#endif
+
+#ifndef USE_STRING_SLABS
+# define USE_STRING_SLABS 0
+#endif
+
+#ifndef USE_HEAP_REGIONS
+# define USE_HEAP_REGIONS 0
+#endif
+
+#ifndef USE_HEAP_QUOTAS
+# define USE_HEAP_QUOTAS 0
+#endif
+
+#ifndef USE_SIMD
+# if defined(__GNUC__)
+#  define USE_SIMD 1
+# else
+#  define USE_SIMD 0
+# endif
+#endif
+
 typedef struct Lax Lax;
 typedef struct cell *pointer;
 
@@ -130,6 +186,22 @@ Lax_EXPORT pointer Lax_call(Lax *sc, pointer func, pointer args);
 Lax_EXPORT pointer Lax_eval(Lax *sc, pointer obj);
 void Lax_set_external_data(Lax *sc, void *p);
 Lax_EXPORT void Lax_define(Lax *sc, pointer env, pointer symbol, pointer value);
+#if USE_INCREMENTAL_GC
+Lax_EXPORT void Lax_set_gc_pause(Lax *sc, long usec);
+#endif
+#if USE_PARALLEL_MARK
+Lax_EXPORT void Lax_set_gc_threads(Lax *sc, int n);
+#endif
+Lax_EXPORT void Lax_protect(Lax *sc, pointer p);
+Lax_EXPORT void Lax_unprotect(Lax *sc, int n);
+#if USE_HEAP_REGIONS
+Lax_EXPORT int Lax_checkpoint(Lax *sc);
+Lax_EXPORT int Lax_reset(Lax *sc);
+#endif
+#if USE_HEAP_QUOTAS
+Lax_EXPORT void Lax_set_heap_limits(Lax *sc, size_t soft, size_t hard);
+Lax_EXPORT size_t Lax_heap_bytes(Lax *sc);
+#endif
 
 typedef pointer (*foreign_func)(Lax *, pointer);
 
@@ -180,16 +252,16 @@ struct Lax_interface {
   int (*is_vector)(pointer p);
   int (*list_length)(Lax *sc, pointer vec);
   long (*vector_length)(pointer vec);
-  void (*fill_vector)(pointer vec, pointer elem);
+  void (*fill_vector)(Lax *sc, pointer vec, pointer elem);
   pointer (*vector_elem)(pointer vec, int ielem);
-  pointer (*set_vector_elem)(pointer vec, int ielem, pointer newel);
+  pointer (*set_vector_elem)(Lax *sc, pointer vec, int ielem, pointer newel);
   int (*is_port)(pointer p);
 
   int (*is_pair)(pointer p);
   pointer (*pair_car)(pointer p);
   pointer (*pair_cdr)(pointer p);
-  pointer (*set_car)(pointer p, pointer q);
-  pointer (*set_cdr)(pointer p, pointer q);
+  pointer (*set_car)(Lax *sc, pointer p, pointer q);
+  pointer (*set_cdr)(Lax *sc, pointer p, pointer q);
 
   int (*is_symbol)(pointer p);
   char *(*symname)(pointer p);
@@ -40,6 +40,11 @@
     _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_LET0REC          )
     _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_LET1REC          )
     _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_LET2REC          )
+    _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_RECEIVE0         )
+    _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_RECEIVE1         )
+    _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_LETV0            )
+    _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_LETV1            )
+    _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_LETV2            )
     _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_COND0            )
     _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_COND1            )
     _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_DELAY            )
@@ -57,6 +62,9 @@
     _OP_DEF(opexe_1, "eval",                           1,  2,       TST_ANY TST_ENVIRONMENT,         OP_PEVAL            )
     _OP_DEF(opexe_1, "apply",                          1,  INF_ARG, TST_NONE,                        OP_PAPPLY           )
     _OP_DEF(opexe_1, "call-with-current-continuation", 1,  1,       TST_NONE,                        OP_CONTINUATION     )
+    _OP_DEF(opexe_1, "values",                         0,  INF_ARG, TST_NONE,                        OP_VALUES           )
+    _OP_DEF(opexe_1, "call-with-values",               2,  2,       TST_NONE,                        OP_CALLVAL          )
+    _OP_DEF(opexe_1, 0,                                0,  0,       0,                               OP_CALLVAL1         )
 #if USE_MATH
     _OP_DEF(opexe_2, "inexact->exact",                 1,  1,       TST_NUMBER,                      OP_INEX2EX          )
     _OP_DEF(opexe_2, "exp",                            1,  1,       TST_NUMBER,                      OP_EXP              )
@@ -144,6 +152,7 @@
     _OP_DEF(opexe_4, "nl",                             0,  1,       TST_OUTPORT,                     OP_NEWLINE          )
     _OP_DEF(opexe_4, "err",                            1,  INF_ARG, TST_NONE,                        OP_ERR0             )
     _OP_DEF(opexe_4, 0,                                0,  0,       0,                               OP_ERR1             )
+    _OP_DEF(opexe_4, 0,                                0,  0,       0,                               OP_ERR2             )
     _OP_DEF(opexe_4, "reverse",                        1,  1,       TST_LIST,                        OP_REVERSE          )
     _OP_DEF(opexe_4, "list*",                          1,  INF_ARG, TST_NONE,                        OP_LIST_STAR        )
     _OP_DEF(opexe_4, "append",                         0,  INF_ARG, TST_NONE,                        OP_APPEND           )
@@ -193,4 +202,76 @@
     _OP_DEF(opexe_6, "get-closure-code",               1,  1,       TST_NONE,                        OP_GET_CLOSURE      )
     _OP_DEF(opexe_6, "closure?",                       1,  1,       TST_NONE,                        OP_CLOSUREP         )
     _OP_DEF(opexe_6, "micro?",                         1,  1,       TST_NONE,                        OP_MICROP           )
+    _OP_DEF(opexe_6, "make-eq-hash-table",             0,  1,       TST_NATURAL,                     OP_MKEQHASH         )
+    _OP_DEF(opexe_6, "make-eqv-hash-table",            0,  1,       TST_NATURAL,                     OP_MKEQVHASH        )
+    _OP_DEF(opexe_6, "make-equal-hash-table",          0,  1,       TST_NATURAL,                     OP_MKEQUALHASH      )
+    _OP_DEF(opexe_6, "make-string-hash-table",         0,  1,       TST_NATURAL,                     OP_MKSTRHASH        )
+    _OP_DEF(opexe_6, "hash-table?",                    1,  1,       TST_NONE,                        OP_HASHP            )
+    _OP_DEF(opexe_6, "hash-table-set!",                3,  3,       TST_HASHTABLE TST_ANY,           OP_HASHSET          )
+    _OP_DEF(opexe_6, "hash-table-ref",                 2,  3,       TST_HASHTABLE TST_ANY,           OP_HASHREF          )
+    _OP_DEF(opexe_6, "hash-table-delete!",             2,  2,       TST_HASHTABLE TST_ANY,           OP_HASHDEL          )
+    _OP_DEF(opexe_6, "hash-table-contains?",           2,  2,       TST_HASHTABLE TST_ANY,           OP_HASHHAS          )
+    _OP_DEF(opexe_6, "hash-table-count",               1,  1,       TST_HASHTABLE,                   OP_HASHCOUNT        )
+    _OP_DEF(opexe_6, "hash-table-keys",                1,  1,       TST_HASHTABLE,                   OP_HASHKEYS         )
+    _OP_DEF(opexe_6, "hash-table->alist",              1,  1,       TST_HASHTABLE,                   OP_HASH2ALIST       )
+    _OP_DEF(opexe_6, "make-weak-eq-hash-table",        0,  1,       TST_NATURAL,                     OP_MKWEAKEQHASH     )
+    _OP_DEF(opexe_6, "make-weak-eqv-hash-table",       0,  1,       TST_NATURAL,                     OP_MKWEAKEQVHASH    )
+    _OP_DEF(opexe_6, "make-weak-equal-hash-table",     0,  1,       TST_NATURAL,                     OP_MKWEAKEQUALHASH  )
+    _OP_DEF(opexe_6, "make-ephemeron-eq-hash-table",   0,  1,       TST_NATURAL,                     OP_MKEPHEQHASH      )
+    _OP_DEF(opexe_6, "make-ephemeron-eqv-hash-table",  0,  1,       TST_NATURAL,                     OP_MKEPHEQVHASH     )
+    _OP_DEF(opexe_6, "make-ephemeron-equal-hash-table", 0, 1,       TST_NATURAL,                     OP_MKEPHEQUALHASH   )
+    _OP_DEF(opexe_6, "hash-table-weak?",               1,  1,       TST_HASHTABLE,                   OP_HASHWEAKP        )
+    _OP_DEF(opexe_6, "make-weak-box",                  1,  1,       TST_NONE,                        OP_MKWEAKBOX        )
+    _OP_DEF(opexe_6, "weak-box?",                      1,  1,       TST_NONE,                        OP_WEAKBOXP         )
+    _OP_DEF(opexe_6, "weak-box-value",                 1,  2,       TST_WEAKBOX TST_ANY,             OP_WEAKBOXVAL       )
+    _OP_DEF(opexe_6, "weak-box-broken?",               1,  1,       TST_WEAKBOX,                     OP_WEAKBOXBROKEN    )
+    _OP_DEF(opexe_6, "make-guardian",                  0,  0,       0,                               OP_MKGUARDIAN       )
+    _OP_DEF(opexe_6, "guardian?",                      1,  1,       TST_NONE,                        OP_GUARDIANP        )
+    _OP_DEF(opexe_6, "guardian-register!",             2,  2,       TST_GUARDIAN TST_ANY,            OP_GUARDREG         )
+    _OP_DEF(opexe_6, "guardian-collect",               1,  1,       TST_GUARDIAN,                    OP_GUARDCOLLECT     )
+    _OP_DEF(opexe_6, "make-record-type",               1,  INF_ARG, TST_NONE,                        OP_MKRECTYPE        )
+    _OP_DEF(opexe_6, "record-constructor",             1,  1,       TST_RECTYPE,                     OP_RECCTOR          )
+    _OP_DEF(opexe_6, "record-predicate",               1,  1,       TST_RECTYPE,                     OP_RECPRED          )
+    _OP_DEF(opexe_6, "record-accessor",                2,  2,       TST_RECTYPE TST_ANY,             OP_RECACC           )
+    _OP_DEF(opexe_6, "record-modifier",                2,  2,       TST_RECTYPE TST_ANY,             OP_RECMOD           )
+    _OP_DEF(opexe_6, "record?",                        1,  1,       TST_NONE,                        OP_RECORDP          )
+    _OP_DEF(opexe_6, 0,                                0,  0,       0,                               OP_RECAPPLY         )
+    _OP_DEF(opexe_6, "make-f64vector",                 1,  2,       TST_NATURAL TST_NUMBER,          OP_MKF64VEC         )
+    _OP_DEF(opexe_6, "make-s64vector",                 1,  2,       TST_NATURAL TST_INTEGER,         OP_MKS64VEC         )
+    _OP_DEF(opexe_6, "make-u8vector",                  1,  2,       TST_NATURAL TST_NATURAL,         OP_MKU8VEC          )
+    _OP_DEF(opexe_6, "f64vector",                      0,  INF_ARG, TST_NUMBER,                      OP_F64VEC           )
+    _OP_DEF(opexe_6, "s64vector",                      0,  INF_ARG, TST_INTEGER,                     OP_S64VEC           )
+    _OP_DEF(opexe_6, "u8vector",                       0,  INF_ARG, TST_NATURAL,                     OP_U8VEC            )
+    _OP_DEF(opexe_6, "f64vector?",                     1,  1,       TST_NONE,                        OP_F64VECP          )
+    _OP_DEF(opexe_6, "s64vector?",                     1,  1,       TST_NONE,                        OP_S64VECP          )
+    _OP_DEF(opexe_6, "u8vector?",                      1,  1,       TST_NONE,                        OP_U8VECP           )
+    _OP_DEF(opexe_6, "numvector-length",               1,  1,       TST_NUMVEC,                      OP_NVLEN            )
+    _OP_DEF(opexe_6, "numvector-ref",                  2,  2,       TST_NUMVEC TST_NATURAL,          OP_NVREF            )
+    _OP_DEF(opexe_6, "numvector-set!",                 3,  3,       TST_NUMVEC TST_NATURAL TST_NUMBER, OP_NVSET         )
+    _OP_DEF(opexe_6, "numvector->list",                1,  1,       TST_NUMVEC,                      OP_NV2LIST          )
+    _OP_DEF(opexe_6, "numvector-add",                  2,  2,       TST_NUMVEC,                      OP_NVADD            )
+    _OP_DEF(opexe_6, "numvector-mul",                  2,  2,       TST_NUMVEC,                      OP_NVMUL            )
+    _OP_DEF(opexe_6, "numvector-scale",                2,  2,       TST_NUMVEC TST_NUMBER,           OP_NVSCALE          )
+    _OP_DEF(opexe_6, "numvector-sum",                  1,  1,       TST_NUMVEC,                      OP_NVSUM            )
+    _OP_DEF(opexe_6, "numvector-min",                  1,  1,       TST_NUMVEC,                      OP_NVMIN            )
+    _OP_DEF(opexe_6, "numvector-max",                  1,  1,       TST_NUMVEC,                      OP_NVMAX            )
+    _OP_DEF(opexe_6, "numvector-dot",                  2,  2,       TST_NUMVEC,                      OP_NVDOT            )
+    _OP_DEF(opexe_6, "bytevector?",                    1,  1,       TST_NONE,                        OP_BVP              )
+    _OP_DEF(opexe_6, "make-bytevector",                1,  2,       TST_NATURAL,                     OP_MKBV             )
+    _OP_DEF(opexe_6, "bytevector",                     0,  INF_ARG, TST_NATURAL,                     OP_BV               )
+    _OP_DEF(opexe_6, "bytevector-length",              1,  1,       TST_BYTEVEC,                     OP_BVLEN            )
+    _OP_DEF(opexe_6, "bytevector-u8-ref",              2,  2,       TST_BYTEVEC TST_NATURAL,         OP_BVREF            )
+    _OP_DEF(opexe_6, "bytevector-u8-set!",             3,  3,       TST_BYTEVEC TST_NATURAL,         OP_BVSET            )
+    _OP_DEF(opexe_6, "bytevector-copy",                1,  3,       TST_BYTEVEC TST_NATURAL,         OP_BVCOPY           )
+    _OP_DEF(opexe_6, "bytevector-copy!",               3,  5,       TST_BYTEVEC TST_NATURAL TST_BYTEVEC TST_NATURAL, OP_BVCOPYB )
+    _OP_DEF(opexe_6, "utf8->string",                   1,  3,       TST_BYTEVEC TST_NATURAL,         OP_UTF82STR         )
+    _OP_DEF(opexe_6, "string->utf8",                   1,  1,       TST_STRING,                      OP_STR2UTF8         )
+    _OP_DEF(opexe_6, "open-binary-input-file",         1,  1,       TST_STRING,                      OP_OPEN_BININFILE   )
+    _OP_DEF(opexe_6, "open-binary-output-file",        1,  1,       TST_STRING,                      OP_OPEN_BINOUTFILE  )
+    _OP_DEF(opexe_6, "read-u8",                        0,  1,       TST_INPORT,                      OP_READ_U8          )
+    _OP_DEF(opexe_6, "peek-u8",                        0,  1,       TST_INPORT,                      OP_PEEK_U8          )
+    _OP_DEF(opexe_6, "write-u8",                       1,  2,       TST_NATURAL TST_OUTPORT,         OP_WRITE_U8         )
+    _OP_DEF(opexe_6, "read-bytevector",                1,  2,       TST_NATURAL TST_INPORT,          OP_READ_BV          )
+    _OP_DEF(opexe_6, "read-bytevector!",               1,  4,       TST_BYTEVEC TST_INPORT TST_NATURAL, OP_READ_BVB      )
+    _OP_DEF(opexe_6, "write-bytevector",               1,  4,       TST_BYTEVEC TST_OUTPORT TST_NATURAL, OP_WRITE_BV     )
 #undef _OP_DEF